@@ -0,0 +1,52 @@
+#
+# Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+#
+# This file is part of casper-osal.
+#
+# casper-osal is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Affero General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# casper-osal is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU Affero General Public License
+# along with osal.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Circular buffer benchmark, usually built with TARGET=release:
+#
+#   make -f benchmark-makefile.mk TARGET=release all
+#   ./out/linux/release/circular_buffer_benchmark --message-size 256 --ring-size 1048576 > results.json
+#
+
+include common.mk
+
+BENCHMARK_SRC := \
+						./benchmark/circular_buffer_benchmark.cc          \
+						./src/osal/posix/posix_circular_buffer.cc         \
+						./src/osal/posix/posix_circular_buffer_no_mmap.cc
+
+BENCHMARK_OBJECTS = $(BENCHMARK_SRC:.cc=.o)
+
+BENCHMARK_NAME:=circular_buffer_benchmark
+BENCHMARK_FILE:=$(OUT_DIR_FOR_TARGET)/$(BENCHMARK_NAME)
+
+ifeq (Darwin, $(PLATFORM))
+  BENCHMARK_LIBS :=
+else
+  BENCHMARK_LIBS := -lpthread -lrt
+endif
+
+all: mk_out_dir $(BENCHMARK_OBJECTS)
+	@$(CXX) $(BENCHMARK_OBJECTS) -o $(BENCHMARK_FILE) $(BENCHMARK_LIBS)
+	@echo "* [$(TARGET)] $(BENCHMARK_FILE) ~> done"
+
+clean_lib:
+	@echo "* [clean] $(BENCHMARK_NAME)..."
+	@rm -f $(BENCHMARK_OBJECTS)
+	@rm -f $(BENCHMARK_FILE)
+
+.SECONDARY:
@@ -0,0 +1,417 @@
+/**
+ * @file circular_buffer_benchmark.cc Throughput and latency benchmark for the circular buffers
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * One producer thread and one consumer thread hand fixed size messages over the ring, each
+ * message carries its send time so the consumer measures the hand-off latency. A second,
+ * single threaded, pass times every produce + consume pair and splits the cost between the
+ * pairs that cross the end of the ring and those that do not.
+ *
+ * Results are written to stdout as one JSON array, one object per ring class.
+ */
+
+#include "osal/posix/posix_circular_buffer.h"
+#include "osal/posix/posix_circular_buffer_no_mmap.h"
+
+#include <pthread.h>
+#include <sched.h>    // for sched_yield, CPU_SET
+#include <stdio.h>
+#include <stdlib.h>   // for strtoull
+#include <string.h>   // for memcpy, strcmp
+#include <time.h>     // for clock_gettime
+
+#include <algorithm>  // for std::sort
+#include <vector>
+
+/**
+ * @brief Benchmark settings, see #Usage.
+ */
+typedef struct {
+    size_t message_size_;
+    size_t ring_size_;
+    size_t messages_;
+    int    producer_cpu_;
+    int    consumer_cpu_;
+    bool   mmap_;
+    bool   no_mmap_;
+} Settings;
+
+/**
+ * @brief Results of one ring class.
+ */
+typedef struct {
+    double   elapsed_s_;
+    uint64_t p50_ns_;
+    uint64_t p99_ns_;
+    uint64_t p999_ns_;
+    uint64_t max_ns_;
+    double   wrapped_ns_;    //!< Average cost of a produce + consume pair that crosses the end of the ring
+    double   contiguous_ns_; //!< Average cost of a produce + consume pair that does not
+    size_t   wraps_;
+} Results;
+
+static inline uint64_t NowNs ()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * @brief Back off while the peer catches up, yields to keep single core hosts usable
+ */
+static inline void Relax (unsigned& a_spins)
+{
+    if ( ++a_spins < 64 ) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else {
+        sched_yield();
+    }
+}
+
+static void Pin (int a_cpu)
+{
+#if defined(__linux__)
+    if ( a_cpu >= 0 ) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(a_cpu, &set);
+        if ( 0 != pthread_setaffinity_np(pthread_self(), sizeof(set), &set) ) {
+            fprintf(stderr, "unable to pin thread to cpu %d\n", a_cpu);
+        }
+    }
+#else
+    OSAL_UNUSED_PARAM(a_cpu);
+#endif
+}
+
+/*
+ * Adapters, same interface on top of both ring classes
+ */
+
+class MmapRing
+{
+public:
+    osal::posix::CircularBuffer ring_;
+    size_t                      head_;
+
+    static const char* Name () { return "CircularBuffer"; }
+
+    bool Init (size_t a_length)
+    {
+        head_ = 0;
+        return ring_.Init(NULL, a_length) && ring_.IsOperational();
+    }
+
+    size_t Size () const { return ring_.Size(); }
+
+    bool Write (const void* a_src, size_t a_length)
+    {
+        if ( false == ring_.ProduceBytes(a_src, a_length) ) {
+            return false;
+        }
+        head_ = ( head_ + a_length ) % ring_.Size();
+        return true;
+    }
+
+    bool Read (void* a_dst, size_t a_length)
+    {
+        size_t available;
+        void*  tail = ring_.Tail(&available);
+        if ( NULL == tail || available < a_length ) {
+            return false;
+        }
+        memcpy(a_dst, tail, a_length);
+        ring_.Consume(a_length);
+        return true;
+    }
+
+    size_t WritePosition () const { return head_; }
+};
+
+class NoMmapRing
+{
+public:
+    osal::posix::CircularBufferNoMmap ring_;
+    size_t                            head_;
+
+    static const char* Name () { return "CircularBufferNoMmap"; }
+
+    bool Init (size_t a_length)
+    {
+        head_ = 0;
+        return ring_.Init(NULL, a_length) && ring_.IsOperational();
+    }
+
+    size_t Size () const { return ring_.Size(); }
+
+    bool Write (const void* a_src, size_t a_length)
+    {
+        if ( ring_.WritableBytes() < a_length ) {
+            return false;
+        }
+        ring_.Write((void*) a_src, a_length);
+        head_ = ( head_ + a_length ) % ring_.Size();
+        return true;
+    }
+
+    bool Read (void* a_dst, size_t a_length)
+    {
+        if ( ring_.ReadableBytes() < a_length ) {
+            return false;
+        }
+        ring_.Read(a_dst, a_length);
+        return true;
+    }
+
+    size_t WritePosition () const { return head_; }
+};
+
+/*
+ * Threaded hand-off
+ */
+
+template <class R>
+struct Context {
+    R*                     ring_;
+    const Settings*        settings_;
+    std::vector<uint64_t>* latencies_;
+    bool                   abort_;     //!< Set when the peer thread could not be started
+};
+
+template <class R>
+static void* Producer (void* a_context)
+{
+    Context<R>*       context  = (Context<R>*) a_context;
+    const Settings*   settings = context->settings_;
+    std::vector<char> message(settings->message_size_, 'x');
+
+    Pin(settings->producer_cpu_);
+    for ( size_t i = 0; i < settings->messages_; ++i ) {
+        unsigned spins = 0;
+        uint64_t now   = NowNs();
+        memcpy(&message[0], &now, sizeof(now));
+        while ( false == context->ring_->Write(&message[0], message.size()) ) {
+            if ( true == __atomic_load_n(&context->abort_, __ATOMIC_ACQUIRE) ) {
+                return NULL;
+            }
+            Relax(spins);
+            // ... the latency is measured from the moment the message fits ...
+            now = NowNs();
+            memcpy(&message[0], &now, sizeof(now));
+        }
+    }
+    return NULL;
+}
+
+template <class R>
+static void* Consumer (void* a_context)
+{
+    Context<R>*       context  = (Context<R>*) a_context;
+    const Settings*   settings = context->settings_;
+    std::vector<char> message(settings->message_size_);
+
+    Pin(settings->consumer_cpu_);
+    for ( size_t i = 0; i < settings->messages_; ++i ) {
+        unsigned spins = 0;
+        while ( false == context->ring_->Read(&message[0], message.size()) ) {
+            if ( true == __atomic_load_n(&context->abort_, __ATOMIC_ACQUIRE) ) {
+                return NULL;
+            }
+            Relax(spins);
+        }
+        const uint64_t now = NowNs();
+        uint64_t       sent;
+        memcpy(&sent, &message[0], sizeof(sent));
+        (*context->latencies_)[i] = now - sent;
+    }
+    return NULL;
+}
+
+/*
+ * Single threaded wrap around cost
+ */
+
+template <class R>
+static void WrapCost (R& a_ring, const Settings& a_settings, Results& o_results)
+{
+    std::vector<char> message(a_settings.message_size_, 'y');
+    double wrapped_ns    = 0.0;
+    double contiguous_ns = 0.0;
+    size_t wraps         = 0;
+    size_t contiguous    = 0;
+
+    // ... when the message size divides the ring size, messages that start on a multiple of it
+    //     never cross the end, shift them by half a message so every lap has one that does ...
+    if ( 0 == a_ring.WritePosition() % message.size() ) {
+        a_ring.Write(&message[0], message.size() / 2);
+        a_ring.Read(&message[0], message.size() / 2);
+    }
+
+    for ( size_t i = 0; i < a_settings.messages_; ++i ) {
+        const bool     wraps_around = a_ring.WritePosition() + message.size() > a_ring.Size();
+        const uint64_t start        = NowNs();
+        a_ring.Write(&message[0], message.size());
+        a_ring.Read(&message[0], message.size());
+        const uint64_t cost = NowNs() - start;
+        if ( true == wraps_around ) {
+            wrapped_ns += (double) cost;
+            wraps      += 1;
+        } else {
+            contiguous_ns += (double) cost;
+            contiguous    += 1;
+        }
+    }
+    o_results.wrapped_ns_    = 0 != wraps      ? wrapped_ns / (double) wraps : 0.0;
+    o_results.contiguous_ns_ = 0 != contiguous ? contiguous_ns / (double) contiguous : 0.0;
+    o_results.wraps_         = wraps;
+}
+
+template <class R>
+static bool Run (const Settings& a_settings, Results& o_results)
+{
+    R ring;
+    if ( false == ring.Init(a_settings.ring_size_) ) {
+        fprintf(stderr, "unable to create a %zu bytes %s\n", a_settings.ring_size_, R::Name());
+        return false;
+    }
+
+    std::vector<uint64_t> latencies(a_settings.messages_);
+    Context<R>            context = { &ring, &a_settings, &latencies, false };
+    pthread_t             producer;
+    pthread_t             consumer;
+
+    const uint64_t start = NowNs();
+    if ( 0 != pthread_create(&consumer, NULL, Consumer<R>, &context) ) {
+        fprintf(stderr, "unable to start the %s consumer thread\n", R::Name());
+        return false;
+    }
+    if ( 0 != pthread_create(&producer, NULL, Producer<R>, &context) ) {
+        fprintf(stderr, "unable to start the %s producer thread\n", R::Name());
+        __atomic_store_n(&context.abort_, true, __ATOMIC_RELEASE);
+        pthread_join(consumer, NULL);
+        return false;
+    }
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    o_results.elapsed_s_ = (double) (NowNs() - start) / 1e9;
+
+    std::sort(latencies.begin(), latencies.end());
+    const size_t count = latencies.size();
+    o_results.p50_ns_  = latencies[count * 50 / 100];
+    o_results.p99_ns_  = latencies[count * 99 / 100];
+    o_results.p999_ns_ = latencies[count * 999 / 1000];
+    o_results.max_ns_  = latencies[count - 1];
+
+    WrapCost(ring, a_settings, o_results);
+    return true;
+}
+
+static void Print (const char* a_name, const Settings& a_settings, const Results& a_results, bool a_first)
+{
+    const double messages = (double) a_settings.messages_;
+    printf("%s  {\n", a_first ? "" : ",\n");
+    printf("    \"ring\": \"%s\",\n", a_name);
+    printf("    \"message_size\": %zu,\n", a_settings.message_size_);
+    printf("    \"ring_size\": %zu,\n", a_settings.ring_size_);
+    printf("    \"messages\": %zu,\n", a_settings.messages_);
+    printf("    \"producer_cpu\": %d,\n", a_settings.producer_cpu_);
+    printf("    \"consumer_cpu\": %d,\n", a_settings.consumer_cpu_);
+    printf("    \"elapsed_s\": %.6f,\n", a_results.elapsed_s_);
+    printf("    \"messages_per_s\": %.0f,\n", messages / a_results.elapsed_s_);
+    printf("    \"bytes_per_s\": %.0f,\n", messages * (double) a_settings.message_size_ / a_results.elapsed_s_);
+    printf("    \"latency_ns\": { \"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu },\n",
+           (unsigned long long) a_results.p50_ns_, (unsigned long long) a_results.p99_ns_,
+           (unsigned long long) a_results.p999_ns_, (unsigned long long) a_results.max_ns_);
+    printf("    \"wrap_ns\": { \"wrapped\": %.1f, \"contiguous\": %.1f, \"wraps\": %zu }\n",
+           a_results.wrapped_ns_, a_results.contiguous_ns_, a_results.wraps_);
+    printf("  }");
+}
+
+static void Usage (const char* a_program)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --ring mmap|no-mmap|both   ring class(es) to drive (default both)\n"
+            "  --message-size BYTES       message size, at least 8 (default 64)\n"
+            "  --ring-size BYTES          ring size (default 65536)\n"
+            "  --messages COUNT           messages per run (default 1000000)\n"
+            "  --producer-cpu CPU         pin the producer thread (default not pinned)\n"
+            "  --consumer-cpu CPU         pin the consumer thread (default not pinned)\n",
+            a_program);
+}
+
+int main (int a_argc, char** a_argv)
+{
+    Settings settings = { 64, 65536, 1000000, -1, -1, true, true };
+
+    for ( int i = 1; i < a_argc; ++i ) {
+        const char* option = a_argv[i];
+        const char* value  = ( i + 1 < a_argc ) ? a_argv[i + 1] : NULL;
+        if ( NULL == value ) {
+            Usage(a_argv[0]);
+            return 1;
+        }
+        if ( 0 == strcmp(option, "--ring") ) {
+            settings.mmap_    = 0 == strcmp(value, "mmap")    || 0 == strcmp(value, "both");
+            settings.no_mmap_ = 0 == strcmp(value, "no-mmap") || 0 == strcmp(value, "both");
+        } else if ( 0 == strcmp(option, "--message-size") ) {
+            settings.message_size_ = (size_t) strtoull(value, NULL, 10);
+        } else if ( 0 == strcmp(option, "--ring-size") ) {
+            settings.ring_size_ = (size_t) strtoull(value, NULL, 10);
+        } else if ( 0 == strcmp(option, "--messages") ) {
+            settings.messages_ = (size_t) strtoull(value, NULL, 10);
+        } else if ( 0 == strcmp(option, "--producer-cpu") ) {
+            settings.producer_cpu_ = atoi(value);
+        } else if ( 0 == strcmp(option, "--consumer-cpu") ) {
+            settings.consumer_cpu_ = atoi(value);
+        } else {
+            Usage(a_argv[0]);
+            return 1;
+        }
+        ++i;
+    }
+    if ( settings.message_size_ < sizeof(uint64_t) || settings.message_size_ > settings.ring_size_
+        || 0 == settings.messages_ || ( false == settings.mmap_ && false == settings.no_mmap_ ) ) {
+        Usage(a_argv[0]);
+        return 1;
+    }
+
+    // ... run everything first, a failed run must not leave half a JSON array on stdout ...
+    Results mmap_results;
+    Results no_mmap_results;
+    if ( true == settings.mmap_ && false == Run<MmapRing>(settings, mmap_results) ) {
+        return 1;
+    }
+    if ( true == settings.no_mmap_ && false == Run<NoMmapRing>(settings, no_mmap_results) ) {
+        return 1;
+    }
+
+    printf("[\n");
+    if ( true == settings.mmap_ ) {
+        Print(MmapRing::Name(), settings, mmap_results, true);
+    }
+    if ( true == settings.no_mmap_ ) {
+        Print(NoMmapRing::Name(), settings, no_mmap_results, false == settings.mmap_);
+    }
+    printf("\n]\n");
+    return 0;
+}
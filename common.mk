@@ -79,16 +79,27 @@ OSAL_HEADERS_DIR := \
 OSAL_SRC := \
 						./src/osal/base_file.cc                           \
 						./src/osal/exception.cc                           \
+						./src/osal/posix/posix_broadcast_circular_buffer.cc \
 						./src/osal/posix/posix_circular_buffer.cc         \
 						./src/osal/posix/posix_circular_buffer_no_mmap.cc \
 						./src/osal/posix/posix_condition_variable.cc      \
 						./src/osal/posix/posix_datagram_socket.cc         \
 						./src/osal/posix/posix_dir.cc                     \
+						./src/osal/posix/posix_event_loop.cc              \
 						./src/osal/posix/posix_file.cc                    \
+						./src/osal/posix/posix_lossy_circular_buffer.cc   \
+						./src/osal/posix/posix_mpmc_circular_buffer.cc    \
 						./src/osal/posix/posix_mutex.cc                   \
+						./src/osal/posix/posix_mutex_profiler.cc          \
+						./src/osal/posix/posix_parallel.cc                \
+						./src/osal/posix/posix_persistent_circular_buffer.cc \
 						./src/osal/posix/posix_random.cc                  \
+						./src/osal/posix/posix_shared_circular_buffer.cc  \
+						./src/osal/posix/posix_spsc_circular_buffer.cc    \
 						./src/osal/posix/posix_thread_helper.cc           \
+						./src/osal/posix/posix_thread_pool.cc             \
 						./src/osal/posix/posix_time.cc                    \
+						./src/osal/posix/posix_timer_wheel.cc             \
 						./src/osal/utf8_string.cc 							          \
 						./src/osal/utils/base_64.cc                       \
 						./src/osal/utils/json_parser_base.cc              \
@@ -32,10 +32,14 @@
 #include <map>
 #include <limits.h>
 #include <stdarg.h>
-#include <mutex> // std::mutext, std::lock_guard
+
+#include "osal/posix/posix_rw_lock.h"
 
 #define OSAL_DEBUG_TRACE_LOCK_GUARD() \
-    std::lock_guard<std::mutex> lock(mutex_);
+    osal::posix::RWLock::WriteGuard lock(lock_);
+
+#define OSAL_DEBUG_TRACE_READ_LOCK_GUARD() \
+    osal::posix::RWLock::ReadGuard lock(lock_);
 
 namespace osal
 {
@@ -51,7 +55,7 @@ namespace osal
             
         private: // Static Data
             
-            std::mutex mutex_;
+            osal::posix::RWLock lock_; //!< Shared for token lookups, exclusive for registration and output
 
         public: // Data Types
 
@@ -207,7 +211,7 @@ namespace osal
          */
         inline bool Trace::IsRegistered (const char* const a_token)
         {
-            OSAL_DEBUG_TRACE_LOCK_GUARD();
+            OSAL_DEBUG_TRACE_READ_LOCK_GUARD();
             return tokens_.end() != tokens_.find(a_token);
         }
         
@@ -220,6 +224,14 @@ namespace osal
          */
         inline void Trace::Log (const std::string& a_token, const char* a_format, ...)
         {
+            // ... most tokens are not registered, tell without excluding other threads ...
+            {
+                OSAL_DEBUG_TRACE_READ_LOCK_GUARD();
+                if ( false == IsRegistered(a_token) ) {
+                    return;
+                }
+            }
+            // ... the buffer is shared, formatting and output are exclusive ...
             OSAL_DEBUG_TRACE_LOCK_GUARD();
             // ...if token is not registered...
             if ( false == IsRegistered(a_token) ) {
@@ -284,13 +296,15 @@ namespace osal
          */
         inline void Trace::LogExtended (const std::string& a_token, const char* a_function, const int& a_line, const char* a_format, ...)
         {
-            OSAL_DEBUG_TRACE_LOCK_GUARD();
-            // ...if token is not registered...
-            if ( false == IsRegistered(a_token) ) {
-                // ... we're done ...
-                return;
+            // ... most tokens are not registered, tell without excluding other threads ...
+            {
+                OSAL_DEBUG_TRACE_READ_LOCK_GUARD();
+                if ( false == IsRegistered(a_token) ) {
+                    return;
+                }
             }
-
+            // ... the buffer is shared, formatting and output are exclusive ...
+            OSAL_DEBUG_TRACE_LOCK_GUARD();
             // ...if token is not registered...
             if ( false == IsRegistered(a_token) ) {
                 // ... we're done ...
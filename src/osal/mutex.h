@@ -35,7 +35,8 @@
     #include "osal/posix/posix_mutex.h"
     namespace osal
     {
-        typedef osal::posix::Mutex Mutex;
+        typedef osal::posix::Mutex         Mutex;
+        typedef osal::posix::MutexProfiler MutexProfiler;
     }
 #endif
 
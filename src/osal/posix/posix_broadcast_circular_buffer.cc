@@ -0,0 +1,157 @@
+/**
+ * @file posix_broadcast_circular_buffer.cc Single producer / multiple reader broadcast circular buffer - implementation
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "osal/posix/posix_broadcast_circular_buffer.h"
+#include <string.h> // for memcpy
+
+void osal::posix::BroadcastCircularBuffer::Init ()
+{
+    write_position_       = 0;
+    cached_read_position_ = 0;
+    policy_               = Policy::WaitForSlowest;
+    for ( int i = 0; i < k_max_readers_; ++i ) {
+        readers_[i].position_ = 0;
+        readers_[i].state_    = Free;
+    }
+}
+
+/**
+ * @brief Initialise buffer, see CircularBuffer::Init
+ *
+ * @param a_data_path Directory for the temporary backing file, may be NULL when using anonymous memory
+ * @param a_length    Length of buffer
+ * @param a_policy    What to do with readers that would block the producer
+ * @param a_options   Bitmask of CircularBuffer::Options
+ */
+bool osal::posix::BroadcastCircularBuffer::Init (const char* a_data_path, size_t a_length, Policy a_policy, uint8_t a_options)
+{
+    Init();
+    policy_ = a_policy;
+    return CircularBuffer::Init(a_data_path, a_length, a_options);
+}
+
+/**
+ * @brief Cleanup buffer
+ *
+ * Releases buffer resources, readers must be gone.
+ */
+void osal::posix::BroadcastCircularBuffer::Close ()
+{
+    CircularBuffer::Close();
+    Init();
+}
+
+/**
+ * @brief Register a reader, it sees every byte produced from now on
+ *
+ * @return Reader id, or -1 if all the #k_max_readers_ slots are taken
+ */
+int osal::posix::BroadcastCircularBuffer::Subscribe ()
+{
+    for ( int i = 0; i < k_max_readers_; ++i ) {
+        Reader&  reader = readers_[i];
+        uint32_t state  = Free;
+        if ( true == __atomic_compare_exchange_n(&reader.state_, &state, (uint32_t) Joining, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED) ) {
+            // ... the slot only counts, and can only be evicted, once its start position is stored ...
+            const uint64_t position = __atomic_load_n(&write_position_, __ATOMIC_SEQ_CST);
+            __atomic_store_n(&reader.position_, position, __ATOMIC_RELEASE);
+            __atomic_store_n(&reader.state_, (uint32_t) Active, __ATOMIC_SEQ_CST);
+            // ... lapped while joining, the start bytes are gone: start from the current position ...
+            const uint64_t write_position = __atomic_load_n(&write_position_, __ATOMIC_SEQ_CST);
+            if ( write_position - position > (uint64_t) length_ ) {
+                __atomic_store_n(&reader.position_, write_position, __ATOMIC_RELEASE);
+            }
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Release a reader slot, evicted or not
+ *
+ * @param a_reader Reader id, as returned by #Subscribe
+ */
+void osal::posix::BroadcastCircularBuffer::Unsubscribe (int a_reader)
+{
+    __atomic_store_n(&readers_[a_reader].state_, (uint32_t) Free, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Rescan the readers to find the slowest one
+ *
+ *  With Policy::EvictLaggards, readers that leave less than the needed bytes free are evicted.
+ *
+ * @param a_needed Number of free bytes the producer is after
+ * @return Number of free bytes
+ */
+size_t osal::posix::BroadcastCircularBuffer::Reclaim (size_t a_needed)
+{
+    uint64_t slowest = write_position_;
+    bool     evicted = false;
+
+    for ( int i = 0; i < k_max_readers_; ++i ) {
+        Reader& reader = readers_[i];
+        if ( Active != __atomic_load_n(&reader.state_, __ATOMIC_ACQUIRE) ) {
+            continue;
+        }
+        uint64_t position = __atomic_load_n(&reader.position_, __ATOMIC_ACQUIRE);
+        if ( write_position_ - position > (uint64_t) length_ ) {
+            // ... lapped while joining, #Subscribe is about to move the reader forward ...
+            position = write_position_ - (uint64_t) length_;
+        }
+        if ( Policy::EvictLaggards == policy_ && (uint64_t) length_ - (write_position_ - position) < (uint64_t) a_needed ) {
+            uint32_t state = Active;
+            if ( true == __atomic_compare_exchange_n(&reader.state_, &state, (uint32_t) Evicted, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED) ) {
+                evicted = true;
+                continue;
+            }
+        }
+        slowest = MIN(slowest, position);
+    }
+    if ( true == evicted ) {
+        // ... the evictions must be visible before the bytes of the evicted readers are overwritten ...
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+    cached_read_position_ = slowest;
+    return (size_t) ((uint64_t) length_ - (write_position_ - slowest));
+}
+
+/**
+ * Helper routine to copy bytes to buffer
+ *
+ *  This copies the given bytes to the buffer, and marks them ready for reading.
+ *
+ * @param a_source Source buffer
+ * @param a_length Number of bytes in source buffer
+ * @return true if bytes copied, false if there was insufficient space
+ */
+bool osal::posix::BroadcastCircularBuffer::ProduceBytes (const void* a_source, size_t a_length)
+{
+    if ( (uint64_t) length_ - (write_position_ - cached_read_position_) < (uint64_t) a_length ) {
+        if ( Reclaim(a_length) < a_length ) {
+            return false;
+        }
+    }
+    memcpy((char*) buffer_ + (write_position_ % (uint64_t) length_), a_source, a_length);
+    Produce(a_length);
+    return true;
+}
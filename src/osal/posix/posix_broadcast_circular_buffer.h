@@ -0,0 +1,207 @@
+#pragma once
+/**
+ * @file posix_broadcast_circular_buffer.h Single producer / multiple reader broadcast circular buffer - header and inline functions
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Same mirrored memory as #CircularBuffer, the producer writes each byte once and every
+ * subscribed reader sees all of them, through its own read position.
+ *
+ * The producer reclaims space up to the slowest reader. #Head rescans the readers on every
+ * call, #ProduceBytes keeps a private copy of the slowest position and only rescans when the
+ * copy says there is not enough room. #Tail reloads the write position on every call, so a
+ * reader waiting for the rest of a record sees it arrive.
+ *
+ * With Policy::EvictLaggards the producer never waits: readers that would block it are
+ * evicted. An evicted reader may have been reading bytes that were overwritten meanwhile,
+ * #Consume tells it so, it must then #Unsubscribe and #Subscribe again.
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_BROADCAST_CIRCULAR_BUFFER_H
+#define NRS_OSAL_POSIX_POSIX_BROADCAST_CIRCULAR_BUFFER_H
+
+#include "osal/posix/posix_circular_buffer.h"
+
+#include <stdint.h>
+
+namespace osal
+{
+    namespace posix
+    {
+        class BroadcastCircularBuffer : protected CircularBuffer
+        {
+        public: // Data Type(s)
+
+            /**
+             * @brief What the producer does when the slowest reader has no room for it.
+             */
+            enum Policy : uint8_t {
+                WaitForSlowest = 0x00, //!< #Head / #ProduceBytes report a full buffer
+                EvictLaggards  = 0x01  //!< Readers in the way are evicted
+            };
+
+        protected: // Data Type(s)
+
+            enum ReaderState : uint32_t {
+                Free    = 0,
+                Active  = 1,
+                Evicted = 2,
+                Joining = 3  //!< Taken by #Subscribe, start position not published yet, the producer skips it
+            };
+
+            /**
+             * @brief Reader slot, each on its own cache line.
+             */
+            typedef struct {
+                alignas(64) uint64_t position_; //!< Reader owned
+                            uint32_t state_;    //!< One of #ReaderState
+            } Reader;
+
+        public: // Const Data
+
+            static const int k_max_readers_ = 8;
+
+        protected: // data
+
+            alignas(64) uint64_t write_position_;        //!< Producer owned
+                        uint64_t cached_read_position_;  //!< Producer copy of the slowest reader position
+                        Policy   policy_;
+                        Reader   readers_[k_max_readers_];
+
+        public: // methods
+
+            BroadcastCircularBuffer ();
+            virtual ~BroadcastCircularBuffer();
+
+            bool  Init      (const char* a_data_path, size_t a_length, Policy a_policy = Policy::WaitForSlowest,
+                             uint8_t a_options = Options::None);
+            void  Close     ();
+
+            using CircularBuffer::Size;
+            using CircularBuffer::IsOperational;
+
+        public: // methods
+
+            // Readers, one thread per reader id
+            int     Subscribe    ();
+            void    Unsubscribe  (int a_reader);
+            bool    IsEvicted    (int a_reader) const;
+            void*   Tail         (int a_reader, size_t* a_available_bytes);
+            bool    Consume      (int a_reader, size_t a_amount);
+
+            // Writing (producing)
+            bool    ProduceBytes (const void* a_source, size_t a_length);
+            void*   Head         (size_t* a_available_bytes);
+            void    Produce      (size_t  a_amount);
+
+        protected:
+
+            void    Init         ();
+            size_t  Reclaim      (size_t  a_needed);
+
+        };
+
+    } // endof namespace posix
+} // endof namespace osal
+
+inline osal::posix::BroadcastCircularBuffer::BroadcastCircularBuffer ()
+{
+    Init();
+}
+
+inline osal::posix::BroadcastCircularBuffer::~BroadcastCircularBuffer ()
+{
+    Close();
+}
+
+/**
+ * @return true if the producer evicted the reader, see Policy::EvictLaggards
+ */
+inline bool osal::posix::BroadcastCircularBuffer::IsEvicted (int a_reader) const
+{
+    return Evicted == __atomic_load_n(&readers_[a_reader].state_, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Access end of buffer, for one reader
+ *
+ * @param a_reader          Reader id, as returned by #Subscribe
+ * @param a_available_bytes On output, the number of bytes ready for reading
+ * @return Pointer to the first bytes ready for reading, or NULL if buffer is empty
+ */
+inline void* osal::posix::BroadcastCircularBuffer::Tail (int a_reader, size_t* a_available_bytes)
+{
+    Reader&        reader         = readers_[a_reader];
+    const uint64_t write_position = __atomic_load_n(&write_position_, __ATOMIC_ACQUIRE);
+    if ( write_position == reader.position_ ) {
+        *a_available_bytes = 0;
+        return NULL;
+    }
+    // ... more than the buffer length only when lapped, after an eviction, keep inside the mapping ...
+    *a_available_bytes = (size_t) MIN(write_position - reader.position_, (uint64_t) length_);
+    return (void*)((char*) buffer_ + (reader.position_ % (uint64_t) length_));
+}
+
+/**
+ * Consume bytes in buffer, for one reader
+ *
+ *  The bytes are freed once every other reader consumed them too.
+ *
+ * @param a_reader Reader id, as returned by #Subscribe
+ * @param a_amount Number of bytes to consume
+ * @return false if the reader was evicted, the bytes it read may have been overwritten
+ */
+inline bool osal::posix::BroadcastCircularBuffer::Consume (int a_reader, size_t a_amount)
+{
+    Reader& reader = readers_[a_reader];
+    // ... the producer evicts before it overwrites, check after the bytes were read ...
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if ( Active != __atomic_load_n(&reader.state_, __ATOMIC_RELAXED) ) {
+        return false;
+    }
+    __atomic_store_n(&reader.position_, reader.position_ + (uint64_t) a_amount, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * Access front of buffer
+ *
+ * @param a_available_bytes On output, the number of bytes ready for writing
+ * @return Pointer to the first bytes ready for writing, or NULL if buffer is full
+ */
+inline void* osal::posix::BroadcastCircularBuffer::Head (size_t* a_available_bytes)
+{
+    *a_available_bytes = Reclaim(1);
+    if ( 0 == *a_available_bytes ) {
+        return NULL;
+    }
+    return (void*)((char*) buffer_ + (write_position_ % (uint64_t) length_));
+}
+
+/**
+ * Produce bytes in buffer
+ *
+ *  This marks the given section of the buffer ready for reading, by every reader.
+ *
+ * @param a_amount Number of bytes to produce
+ */
+inline void osal::posix::BroadcastCircularBuffer::Produce (size_t a_amount)
+{
+    __atomic_store_n(&write_position_, write_position_ + (uint64_t) a_amount, __ATOMIC_RELEASE);
+}
+
+#endif // NRS_OSAL_POSIX_POSIX_BROADCAST_CIRCULAR_BUFFER_H
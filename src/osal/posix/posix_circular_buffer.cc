@@ -31,6 +31,18 @@
 #include <unistd.h>   // for close, ftruncate
 #include <fcntl.h>    // for open
 #include <stdio.h>    // Temporary
+#include <sys/stat.h> // for S_IRUSR, S_IWUSR
+
+#include <errno.h>    // for errno
+#include <limits.h>   // for INT_MAX
+#include <time.h>     // for clock_gettime
+
+#if defined(__linux__)
+    #include <sys/syscall.h> // for SYS_memfd_create, SYS_futex
+    #include <linux/memfd.h> // for MFD_CLOEXEC, MFD_HUGETLB
+    #include <linux/futex.h> // for FUTEX_WAIT, FUTEX_WAKE
+    #include <sys/eventfd.h> // for eventfd
+#endif
 
 #ifdef __ANDROID__
 #undef perror
@@ -47,6 +59,10 @@ void osal::posix::CircularBuffer::Init ()
     head_       = 0;
     fill_count_ = 0;
     seekable_   = true;
+    read_threshold_  = 0;
+    write_threshold_ = 0;
+    wake_sequence_   = 0;
+    event_fd_        = -1;
 }
 
 /**
@@ -54,54 +70,69 @@ void osal::posix::CircularBuffer::Init ()
  *
  * Note that the length is advisory only: Because of the way the
  * memory mirroring technique works, the true buffer length will
- * be multiples of the device page size (e.g. 4096 bytes)
+ * be multiples of the device page size (e.g. 4096 bytes), or of the
+ * huge page size (2MB) when huge pages were granted.
  *
- * @param a_length Length of buffer
+ * @param a_data_path Directory for the temporary backing file, may be NULL when using anonymous memory
+ * @param a_length    Length of buffer
+ * @param a_options   Bitmask of #Options to select the backing store
  */
-bool osal::posix::CircularBuffer::Init (const char* a_data_path, int32_t a_length)
+bool osal::posix::CircularBuffer::Init (const char* a_data_path, size_t a_length, uint8_t a_options)
 {
-    char szTmp[1024];
-    int32_t page_size = 4096;
-    int fd = -1;
+    size_t  page_size = (size_t) sysconf(_SC_PAGESIZE);
+    bool    huge_tlb  = false;
+    int     fd        = -1;
 
     int status;
 
     Close();
 
-    // The buffer length must be a multiple of page size
-    length_ = ((a_length + page_size - 1) / page_size) * page_size;
-
-    snprintf(szTmp, sizeof(szTmp), "%s%s%p.tmp", a_data_path, a_data_path[strlen(a_data_path)-1] == '/' ? "" : "/", (void*) this);
-    fd = open(szTmp, O_RDWR | O_CREAT);
-    if ( fd < 1 ) {
-        perror("open");
-        goto cleanup;
-    }
-    status = unlink(szTmp);
-    if (status) {
-        perror("unlink");
-        goto cleanup;
+    if ( NULL == a_data_path ) {
+        a_options |= Options::Anonymous;
     }
-    status = ftruncate(fd, length_);
-    if (status) {
-        perror("ftruncate");
-        goto cleanup;
-    }
-    buffer_ = mmap(NULL, length_ * 2, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_SHARED, -1, 0);
-    if (buffer_ == MAP_FAILED) {
-        perror("map anon");
-        goto cleanup;
+
+    if ( 0 != ( a_options & Options::Anonymous ) && 0 != ( a_options & Options::HugePages ) ) {
+        // ... the huge page pool may be empty, in that case the mapping fails and we fall back ...
+        fd = OpenAnonymous(true);
+        if ( -1 != fd ) {
+            length_  = ((a_length + k_huge_page_size_ - 1) / k_huge_page_size_) * k_huge_page_size_;
+            huge_tlb = ( 0 == ftruncate(fd, (off_t) length_) && true == Mirror(fd, k_huge_page_size_) );
+            if ( false == huge_tlb ) {
+                close(fd);
+                fd = -1;
+                Close();
+            }
+        }
     }
-    lower_half_ = mmap(buffer_, length_, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_SHARED, fd, 0);
-    if ( lower_half_ == MAP_FAILED) {
-        perror("map lower");
-        goto cleanup;
+
+    if ( false == huge_tlb ) {
+        if ( 0 != ( a_options & Options::Anonymous ) ) {
+            fd = OpenAnonymous(false);
+        } else {
+            fd = OpenTemporary(a_data_path);
+        }
+        if ( -1 == fd ) {
+            goto cleanup;
+        }
+
+        // The buffer length must be a multiple of page size
+        length_ = ((a_length + page_size - 1) / page_size) * page_size;
+
+        status = ftruncate(fd, (off_t) length_);
+        if (status) {
+            perror("ftruncate");
+            goto cleanup;
+        }
+        if ( false == Mirror(fd, page_size) ) {
+            goto cleanup;
+        }
     }
-    upper_half_ = mmap((int8_t*) buffer_ + length_, length_, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_SHARED, fd, 0);
-    if ( upper_half_ == MAP_FAILED ) {
-        perror("map upper");
-        goto cleanup;
+#ifdef MADV_HUGEPAGE
+    if ( 0 != ( a_options & Options::HugePages ) && false == huge_tlb ) {
+        // ... no reserved huge pages, transparent huge pages are only a hint ...
+        (void) madvise(buffer_, length_ * 2, MADV_HUGEPAGE);
     }
+#endif
     status = close(fd);
     if ( status == 0 ) {
         head_ = 0;
@@ -117,11 +148,112 @@ bool osal::posix::CircularBuffer::Init (const char* a_data_path, int32_t a_lengt
         return true;
     }
  cleanup:
-    close(fd);
+    if ( -1 != fd ) {
+        close(fd);
+    }
     Close();
     return false;
 }
 
+/**
+ * @brief Create and unlink a temporary backing file under the data path
+ *
+ * @param a_data_path Directory where the file is created
+ * @return The file descriptor or -1 on error
+ */
+int osal::posix::CircularBuffer::OpenTemporary (const char* a_data_path)
+{
+    char szTmp[1024];
+
+    snprintf(szTmp, sizeof(szTmp), "%s%s%p.tmp", a_data_path, a_data_path[strlen(a_data_path)-1] == '/' ? "" : "/", (void*) this);
+    int fd = open(szTmp, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if ( fd < 0 ) {
+        perror("open");
+        return -1;
+    }
+    if ( 0 != unlink(szTmp) ) {
+        perror("unlink");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Create an anonymous memory object to back the buffer
+ *
+ * On linux this is a memfd, elsewhere a POSIX shared memory object unlinked right away.
+ *
+ * @param a_huge_pages When true the object is allocated from the huge page pool (linux only)
+ * @return The file descriptor or -1 on error
+ */
+int osal::posix::CircularBuffer::OpenAnonymous (bool a_huge_pages)
+{
+#if defined(__linux__) && defined(SYS_memfd_create)
+    unsigned int flags = MFD_CLOEXEC;
+    if ( true == a_huge_pages ) {
+        flags |= MFD_HUGETLB;
+    }
+    int fd = (int) syscall(SYS_memfd_create, "osal-circular-buffer", flags);
+    if ( fd < 0 && false == a_huge_pages ) {
+        perror("memfd_create");
+    }
+    return fd < 0 ? -1 : fd;
+#else
+    if ( true == a_huge_pages ) {
+        return -1;
+    }
+    char szTmp[64];
+    snprintf(szTmp, sizeof(szTmp), "/osal-cb-%d-%p", (int) getpid(), (void*) this);
+    int fd = shm_open(szTmp, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    if ( fd < 0 ) {
+        perror("shm_open");
+        return -1;
+    }
+    shm_unlink(szTmp);
+    return fd;
+#endif
+}
+
+/**
+ * @brief Map the backing object twice, back to back, in a single reserved region
+ *
+ * @param a_fd        Backing object, already sized to #length_
+ * @param a_alignment Required alignment of the region (page or huge page size)
+ * @return true on success
+ */
+bool osal::posix::CircularBuffer::Mirror (int a_fd, size_t a_alignment)
+{
+    const size_t region = length_ * 2;
+    const size_t slop   = a_alignment - (size_t) sysconf(_SC_PAGESIZE);
+
+    uint8_t* reserved = (uint8_t*) mmap(NULL, region + slop, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if ( reserved == MAP_FAILED ) {
+        perror("map anon");
+        return false;
+    }
+    uint8_t* aligned = (uint8_t*) ((((uintptr_t) reserved) + a_alignment - 1) & ~((uintptr_t) a_alignment - 1));
+    if ( aligned != reserved ) {
+        munmap(reserved, aligned - reserved);
+    }
+    if ( aligned + region != reserved + region + slop ) {
+        munmap(aligned + region, (reserved + region + slop) - (aligned + region));
+    }
+    buffer_ = aligned;
+
+    lower_half_ = mmap(buffer_, length_, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_SHARED, a_fd, 0);
+    if ( lower_half_ == MAP_FAILED) {
+        perror("map lower");
+        return false;
+    }
+    upper_half_ = mmap((int8_t*) buffer_ + length_, length_, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_SHARED, a_fd, 0);
+    if ( upper_half_ == MAP_FAILED ) {
+        perror("map upper");
+        return false;
+    }
+    return true;
+}
+
 /**
  * @brief Cleanup buffer
  *
@@ -129,6 +261,9 @@ bool osal::posix::CircularBuffer::Init (const char* a_data_path, int32_t a_lengt
  */
 void osal::posix::CircularBuffer::Close ()
 {
+    if ( -1 != event_fd_ ) {
+        close(event_fd_);
+    }
     if ( length_ != 0 ) {
         if ( lower_half_ != MAP_FAILED ) {
             munmap(lower_half_, length_);
@@ -153,7 +288,7 @@ void osal::posix::CircularBuffer::Close ()
  */
 void osal::posix::CircularBuffer::Clear ()
 {
-    int32_t count;
+    size_t count;
     if ( Tail(&count) != 0 ) {
         Consume(count);
     }
@@ -169,11 +304,12 @@ void osal::posix::CircularBuffer::Clear ()
  * @param a_length Number of bytes in source buffer
  * @return true if bytes copied, false if there was insufficient space
  */
-bool osal::posix::CircularBuffer::ProduceBytes (const void* a_src, int32_t a_length)
+bool osal::posix::CircularBuffer::ProduceBytes (const void* a_src, size_t a_length)
 {
-    int32_t space;
+    size_t space;
     void *ptr = Head(&space);
     if ( space < a_length ) {
+        OSAL_CIRCULAR_BUFFER_STATS(if ( NULL != ptr ) counters_.Full());
         return false;
     } else {
         memcpy(ptr, a_src, a_length);
@@ -182,4 +318,195 @@ bool osal::posix::CircularBuffer::ProduceBytes (const void* a_src, int32_t a_len
     }
 }
 
+/**
+ * @brief Gather several fragments into the buffer and publish them at once
+ *
+ *  Either every fragment is copied or nothing is, the consumer never sees a partial message.
+ *
+ * @param a_iov       Fragments to copy
+ * @param a_iov_count Number of fragments
+ * @return true if all fragments were produced, false if there is not enough space
+ */
+bool osal::posix::CircularBuffer::ProduceBytesV (const struct iovec* a_iov, int a_iov_count)
+{
+    size_t total = 0;
+    for ( int i = 0; i < a_iov_count; ++i ) {
+        total += a_iov[i].iov_len;
+    }
+    size_t space;
+    char*  ptr = (char*) Head(&space);
+    if ( space < total ) {
+        OSAL_CIRCULAR_BUFFER_STATS(if ( NULL != ptr ) counters_.Full());
+        return false;
+    }
+    for ( int i = 0; i < a_iov_count; ++i ) {
+        memcpy(ptr, a_iov[i].iov_base, a_iov[i].iov_len);
+        ptr += a_iov[i].iov_len;
+    }
+    if ( 0 != total ) {
+        Produce(total);
+    }
+    return true;
+}
+
+
+/**
+ * @brief Read from a descriptor straight into the front of the buffer
+ *
+ *  Thanks to the mirrored mapping the free space is always contiguous, a single read(2) fills it.
+ *
+ * @param a_fd        Descriptor to read from
+ * @param a_max_bytes Maximum number of bytes to read
+ * @return Number of bytes produced, 0 on end of file, -1 on error ( errno is ENOBUFS when the buffer is full )
+ */
+ssize_t osal::posix::CircularBuffer::ProduceFromFd (int a_fd, size_t a_max_bytes)
+{
+    size_t space;
+    void*  ptr = Head(&space);
+    if ( NULL == ptr ) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    ssize_t rv;
+    do {
+        rv = read(a_fd, ptr, MIN(space, a_max_bytes));
+    } while ( -1 == rv && EINTR == errno );
+    if ( rv > 0 ) {
+        Produce((size_t) rv);
+    }
+    return rv;
+}
+
+/**
+ * @brief Write the end of the buffer straight to a descriptor
+ *
+ * @param a_fd        Descriptor to write to
+ * @param a_max_bytes Maximum number of bytes to write
+ * @return Number of bytes consumed, 0 when the buffer is empty, -1 on error
+ */
+ssize_t osal::posix::CircularBuffer::ConsumeToFd (int a_fd, size_t a_max_bytes)
+{
+    size_t count;
+    void*  ptr = Tail(&count);
+    if ( NULL == ptr ) {
+        return 0;
+    }
+    ssize_t rv;
+    do {
+        rv = write(a_fd, ptr, MIN(count, a_max_bytes));
+    } while ( -1 == rv && EINTR == errno );
+    if ( rv > 0 ) {
+        Consume((size_t) rv);
+    }
+    return rv;
+}
+
+/**
+ * @brief Park the calling thread until the fill count crosses a threshold
+ *
+ *  The threshold is published before the fill count is re-checked, and the other
+ *  side reads it after its atomic update of the fill count, so a wake-up is never lost.
+ *  The other side only enters the kernel when the threshold is crossed. The futex word
+ *  is a separate 32 bit sequence, the fill count is wider than a futex.
+ *
+ * @param a_threshold  Threshold slot of the calling side
+ * @param a_min_bytes  Number of bytes required
+ * @param a_readable   true when waiting for data, false when waiting for space
+ * @param a_timeout_ms Maximum time to wait in milliseconds, -1 to wait forever
+ * @return true if the condition is met, false on timeout
+ */
+bool osal::posix::CircularBuffer::Wait (volatile size_t* a_threshold, size_t a_min_bytes, bool a_readable, int64_t a_timeout_ms)
+{
+    struct timespec deadline;
+    if ( a_timeout_ms >= 0 ) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec  += a_timeout_ms / 1000;
+        deadline.tv_nsec += (a_timeout_ms % 1000) * 1000000;
+        if ( deadline.tv_nsec >= 1000000000 ) {
+            deadline.tv_sec  += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    bool rv = false;
+    __atomic_store_n(a_threshold, a_min_bytes, __ATOMIC_SEQ_CST);
+    for ( ;; ) {
+        const uint32_t sequence   = __atomic_load_n(&wake_sequence_, __ATOMIC_SEQ_CST);
+        const size_t   fill_count = __atomic_load_n(&fill_count_, __ATOMIC_SEQ_CST);
+        if ( ( true == a_readable ? fill_count : length_ - fill_count ) >= a_min_bytes ) {
+            rv = true;
+            break;
+        }
+        struct timespec  remaining;
+        struct timespec* timeout = NULL;
+        if ( a_timeout_ms >= 0 ) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            remaining.tv_sec  = deadline.tv_sec  - now.tv_sec;
+            remaining.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+            if ( remaining.tv_nsec < 0 ) {
+                remaining.tv_sec  -= 1;
+                remaining.tv_nsec += 1000000000;
+            }
+            if ( remaining.tv_sec < 0 ) {
+                break;
+            }
+            timeout = &remaining;
+        }
+#if defined(__linux__)
+        // ... EAGAIN, EINTR and ETIMEDOUT all lead back to the checks above ...
+        (void) syscall(SYS_futex, &wake_sequence_, FUTEX_WAIT_PRIVATE, sequence, timeout, NULL, 0);
+#else
+        OSAL_UNUSED_PARAM(timeout);
+        OsalSleepMs(1);
+#endif
+    }
+    __atomic_store_n(a_threshold, 0, __ATOMIC_SEQ_CST);
+    return rv;
+}
+
+/**
+ * @brief Wake the sleeping side, if any
+ */
+void osal::posix::CircularBuffer::Wake ()
+{
+    __atomic_add_fetch(&wake_sequence_, 1, __ATOMIC_SEQ_CST);
+#if defined(__linux__)
+    syscall(SYS_futex, &wake_sequence_, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#endif
+}
 
+/**
+ * @brief Make the event file descriptor readable
+ */
+void osal::posix::CircularBuffer::Signal ()
+{
+#if defined(__linux__)
+    const eventfd_t one = 1;
+    (void) eventfd_write(event_fd_, one);
+#endif
+}
+
+/**
+ * @brief Create an event file descriptor that becomes readable when data is produced into an empty buffer
+ *
+ *  Meant to be registered with epoll / poll next to other descriptors. When it fires the consumer
+ *  must read the descriptor (to reset it) and then consume until #Tail returns NULL, otherwise no
+ *  new event is raised. Must be called after #Init, the descriptor is closed by #Close.
+ *
+ * @return The non-blocking event file descriptor or -1 when not supported
+ */
+int osal::posix::CircularBuffer::EnableEventFd ()
+{
+#if defined(__linux__)
+    if ( -1 == event_fd_ ) {
+        event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if ( -1 == event_fd_ ) {
+            perror("eventfd");
+        } else if ( 0 != fill_count_ ) {
+            Signal();
+        }
+    }
+#endif
+    return event_fd_;
+}
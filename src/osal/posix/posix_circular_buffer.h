@@ -27,9 +27,13 @@
 #ifndef NRS_OSAL_POSIX_POSIX_CIRCULARBUFFER_H
 #define NRS_OSAL_POSIX_POSIX_CIRCULARBUFFER_H
 #include "osal/osalite.h"
+#include "osal/posix/posix_circular_buffer_stats.h"
 
 #include <stdint.h>
 #include <stdlib.h>   // for NULL
+#include <stddef.h>   // for size_t
+#include <sys/types.h> // for ssize_t
+#include <sys/uio.h>   // for struct iovec
 #include <sys/mman.h> // for mmap
 
 namespace osal
@@ -38,50 +42,104 @@ namespace osal
     {
         class CircularBuffer
         {
+        public: // Data Type(s)
+
+            /**
+             * @brief Backing store options for #Init.
+             */
+            enum Options : uint8_t {
+                None      = 0x00, //!< Temporary file under the data path (legacy behaviour)
+                Anonymous = 0x01, //!< Anonymous memory (memfd), no filesystem required
+                HugePages = 0x02  //!< Ask for huge pages, MAP_HUGETLB when possible, THP hint otherwise
+            };
+
+        protected: // Const Data
+
+            static const size_t k_huge_page_size_ = 2 * 1024 * 1024;
+
+        public: // Const Data
+
+            static const size_t k_record_header_size_ = sizeof(uint64_t); //!< Length prefix of each record
+
         protected: // data
 
             void*             buffer_;
             void*             upper_half_;
             void*             lower_half_;
-            int32_t           length_;
-            int32_t           tail_;
-            int32_t           head_;
+            size_t            length_;
+            size_t            tail_;
+            size_t            head_;
             bool              seekable_;
-            volatile int32_t  fill_count_;
+            volatile size_t   fill_count_;
+            volatile size_t   read_threshold_;  //!< Bytes awaited by a sleeping consumer, 0 when none
+            volatile size_t   write_threshold_; //!< Space awaited by a sleeping producer, 0 when none
+            volatile uint32_t wake_sequence_;   //!< Futex word, bumped on every wake-up
+            int               event_fd_;        //!< Readable while the buffer is not empty, -1 when not enabled
+            CircularBufferCounters counters_;   //!< Only updated with ENABLE_CIRCULAR_BUFFER_STATS
 
         public: // methods
 
             CircularBuffer ();
             virtual ~CircularBuffer();
 
-            bool  Init      (const char* a_data_path, int32_t a_length);
+            bool  Init      (const char* a_data_path, size_t a_length, uint8_t a_options = Options::None);
             void  Clear     ();
             void  Close     ();
 
         public: // methods
 
             // Reading (consuming)
-            void*   Tail         (int32_t* a_available_bytes);
-            void    Consume      (int32_t  a_amount);
+            void*   Tail         (size_t* a_available_bytes);
+            void    Consume      (size_t  a_amount);
 
             // Writing (producing)
-            bool    ProduceBytes (const void* a_source, int32_t a_length);
-            void*   Head         (int32_t* a_available_bytes);
-            void    Produce      (int32_t  a_amount);
+            bool    ProduceBytes (const void* a_source, size_t a_length);
+            bool    ProduceBytesV(const struct iovec* a_iov, int a_iov_count);
+            void*   Head         (size_t* a_available_bytes);
+            void    Produce      (size_t  a_amount);
+
+            // Direct descriptor I/O, no intermediate copy
+            ssize_t ProduceFromFd (int a_fd, size_t a_max_bytes);
+            ssize_t ConsumeToFd   (int a_fd, size_t a_max_bytes);
+
+            // Framed records (do not mix with the raw byte API on the same buffer)
+            void*       ReserveRecord (size_t  a_length);
+            void        CommitRecord  (size_t  a_length);
+            const void* PeekRecord    (size_t* o_length);
+            void        ReleaseRecord ();
+            size_t      PeekRecords   (struct iovec* o_records, size_t a_max_records);
+            void        ConsumeBatch  (size_t  a_record_count);
+
+            static size_t RecordSize (size_t a_length);
 
             // Seek mode for random access (*not* thread safe)
-            int32_t  Size             () const;
+            size_t   Size             () const;
             int      Seek             (int64_t a_offset, int a_whence);
-            long int Tell             () const;
+            int64_t  Tell             () const;
             bool     IsSeekable       () const;
-            int      SeekableReadSize () const;
+            int64_t  SeekableReadSize () const;
             void     ClearAndRewind   ();
             bool     IsOperational    ();
 
+            // Blocking (one consumer and one producer may sleep)
+            bool     WaitForReadable  (size_t a_min_bytes, int64_t a_timeout_ms = -1);
+            bool     WaitForWritable  (size_t a_min_bytes, int64_t a_timeout_ms = -1);
+            int      EnableEventFd    ();
+            int      GetEventFd       () const;
+
+            // Instrumentation, see posix_circular_buffer_stats.h
+            void     GetStats         (CircularBufferStats& o_stats) const;
+            void     ResetStats       ();
 
         protected:
 
-            void  Init    ();
+            void  Init          ();
+            int   OpenTemporary (const char* a_data_path);
+            int   OpenAnonymous (bool a_huge_pages);
+            bool  Mirror        (int a_fd, size_t a_alignment);
+            bool  Wait          (volatile size_t* a_threshold, size_t a_min_bytes, bool a_readable, int64_t a_timeout_ms);
+            void  Wake          ();
+            void  Signal        ();
 
         };
 
@@ -98,7 +156,7 @@ inline osal::posix::CircularBuffer::~CircularBuffer ()
     Close();
 }
 
-inline int32_t osal::posix::CircularBuffer::Size () const
+inline size_t osal::posix::CircularBuffer::Size () const
 {
     return length_;
 }
@@ -112,10 +170,11 @@ inline int32_t osal::posix::CircularBuffer::Size () const
  * @param a_available_bytes On output, the number of bytes ready for reading
  * @return Pointer to the first bytes ready for reading, or NULL if buffer is empty
  */
-inline void* osal::posix::CircularBuffer::Tail (int32_t* a_available_bytes)
+inline void* osal::posix::CircularBuffer::Tail (size_t* a_available_bytes)
 {
     *a_available_bytes = fill_count_;
     if ( *a_available_bytes == 0 ) {
+        OSAL_CIRCULAR_BUFFER_STATS(counters_.Empty());
         return NULL;
     }
     return (void*)((char*) buffer_ + tail_);
@@ -128,10 +187,16 @@ inline void* osal::posix::CircularBuffer::Tail (int32_t* a_available_bytes)
  *
  * @param a_amount Number of bytes to consume
  */
-inline void osal::posix::CircularBuffer::Consume (int32_t a_amount)
+inline void osal::posix::CircularBuffer::Consume (size_t a_amount)
 {
-    tail_ = (tail_ + a_amount) % length_;
-    __sync_add_and_fetch(&fill_count_, -a_amount);
+    // ... a_amount never exceeds length_, one conditional subtraction replaces the 64 bit division ...
+    const size_t tail = tail_ + a_amount;
+    tail_ = tail - ( tail >= length_ ? length_ : 0 );
+    const size_t fill_count = __sync_sub_and_fetch(&fill_count_, a_amount);
+    OSAL_CIRCULAR_BUFFER_STATS(counters_.Consumed(a_amount));
+    if ( 0 != write_threshold_ && length_ - fill_count >= write_threshold_ ) {
+        Wake();
+    }
 }
 
 /**
@@ -143,10 +208,11 @@ inline void osal::posix::CircularBuffer::Consume (int32_t a_amount)
  * @param a_available_bytes On output, the number of bytes ready for writing
  * @return Pointer to the first bytes ready for writing, or NULL if buffer is full
  */
-inline void* osal::posix::CircularBuffer::Head (int32_t* a_available_bytes)
+inline void* osal::posix::CircularBuffer::Head (size_t* a_available_bytes)
 {
     *a_available_bytes = (length_ - fill_count_);
     if ( *a_available_bytes == 0 ) {
+        OSAL_CIRCULAR_BUFFER_STATS(counters_.Full());
         return NULL;
     }
     return (void*)((char*) buffer_ + head_);
@@ -159,15 +225,128 @@ inline void* osal::posix::CircularBuffer::Head (int32_t* a_available_bytes)
  *
  * @param a_amount Number of bytes to produce
  */
-inline void osal::posix::CircularBuffer::Produce (int a_amount)
+inline void osal::posix::CircularBuffer::Produce (size_t a_amount)
 {
-    if ( head_ + a_amount >= length_ ) {
-        head_     = (head_ + a_amount) % length_;
-        seekable_ = false;
-    } else {
-        head_ += a_amount;
+    const size_t head    = head_ + a_amount;
+    const bool   wrapped = ( head >= length_ );
+    head_     = head - ( wrapped ? length_ : 0 );
+    seekable_ = seekable_ & ! wrapped;
+    const size_t fill_count = __sync_add_and_fetch(&fill_count_, a_amount);
+    OSAL_CIRCULAR_BUFFER_STATS(counters_.Produced(a_amount, fill_count, wrapped));
+    if ( 0 != read_threshold_ && fill_count >= read_threshold_ ) {
+        Wake();
+    }
+    if ( -1 != event_fd_ && fill_count == a_amount ) {
+        Signal();
+    }
+}
+
+/**
+ * @brief Bytes used in the buffer by a record, prefix and padding included
+ *
+ * @param a_length Payload length
+ */
+inline size_t osal::posix::CircularBuffer::RecordSize (size_t a_length)
+{
+    return k_record_header_size_ + ((a_length + 7) & ~((size_t) 7));
+}
+
+/**
+ * @brief Reserve a record at the front of the buffer
+ *
+ *  The payload is always contiguous, the mirrored mapping takes care of the wrap around.
+ *  Nothing is visible to the consumer until #CommitRecord.
+ *
+ * @param a_length Maximum payload length
+ * @return Pointer to the payload, or NULL if there is not enough space
+ */
+inline void* osal::posix::CircularBuffer::ReserveRecord (size_t a_length)
+{
+    size_t  available;
+    void*   head = Head(&available);
+    if ( available < RecordSize(a_length) ) {
+        OSAL_CIRCULAR_BUFFER_STATS(if ( NULL != head ) counters_.Full());
+        return NULL;
+    }
+    return (char*) head + k_record_header_size_;
+}
+
+/**
+ * @brief Publish the record obtained with #ReserveRecord
+ *
+ * @param a_length Payload length, must not exceed the reserved length
+ */
+inline void osal::posix::CircularBuffer::CommitRecord (size_t a_length)
+{
+    *(uint64_t*) ((char*) buffer_ + head_) = (uint64_t) a_length;
+    Produce(RecordSize(a_length));
+}
+
+/**
+ * @brief Access the oldest record
+ *
+ * @param o_length On output, the payload length
+ * @return Pointer to the contiguous payload, or NULL if there is no record
+ */
+inline const void* osal::posix::CircularBuffer::PeekRecord (size_t* o_length)
+{
+    size_t  available;
+    void*   tail = Tail(&available);
+    if ( NULL == tail ) {
+        *o_length = 0;
+        return NULL;
+    }
+    *o_length = (size_t) *(const uint64_t*) tail;
+    return (const char*) tail + k_record_header_size_;
+}
+
+/**
+ * @brief Release the record returned by #PeekRecord
+ */
+inline void osal::posix::CircularBuffer::ReleaseRecord ()
+{
+    Consume(RecordSize((size_t) *(const uint64_t*) ((const char*) buffer_ + tail_)));
+}
+
+/**
+ * @brief Access the oldest records without releasing them
+ *
+ *  Each payload is contiguous, the mirrored mapping takes care of the wrap around.
+ *
+ * @param o_records     On output, pointer and length of each payload
+ * @param a_max_records Capacity of @a o_records
+ * @return Number of records filled in
+ */
+inline size_t osal::posix::CircularBuffer::PeekRecords (struct iovec* o_records, size_t a_max_records)
+{
+    const size_t available = fill_count_;
+    size_t       offset    = 0;
+    size_t       count     = 0;
+
+    while ( count < a_max_records && offset < available ) {
+        char* record = (char*) buffer_ + tail_ + offset;
+        o_records[count].iov_len  = (size_t) *(const uint64_t*) record;
+        o_records[count].iov_base = record + k_record_header_size_;
+        offset += RecordSize(o_records[count].iov_len);
+        count  += 1;
+    }
+    return count;
+}
+
+/**
+ * @brief Release the oldest records with a single update of the fill count
+ *
+ * @param a_record_count Number of records to release, as returned by #PeekRecords
+ */
+inline void osal::posix::CircularBuffer::ConsumeBatch (size_t a_record_count)
+{
+    size_t offset = 0;
+    for ( size_t i = 0; i < a_record_count; ++i ) {
+        offset += RecordSize((size_t) *(const uint64_t*) ((const char*) buffer_ + tail_ + offset));
+    }
+    if ( 0 != offset ) {
+        Consume(offset);
     }
-    __sync_add_and_fetch(&fill_count_, a_amount);
 }
 
 /**
@@ -185,22 +364,22 @@ inline int osal::posix::CircularBuffer::Seek (int64_t a_offset, int a_whence)
     int     rv = -1;
 
     if ( true == seekable_ ) {
-        int32_t offset = -1;
+        int64_t offset = -1;
 
         switch(a_whence) {
             case SEEK_SET:
-                offset = (int32_t) a_offset;
+                offset = a_offset;
                 break;
             case SEEK_CUR:
-                offset = tail_ + (int32_t) a_offset;
+                offset = (int64_t) tail_ + a_offset;
                 break;
             case SEEK_END:
-                offset = head_ - (int32_t) a_offset;
+                offset = (int64_t) head_ - a_offset;
                 break;
         }
-        if ( offset >= 0 && offset <= (int32_t) head_ ) { // note <= is needed to place SEEK_END past last byte
-            tail_ = offset;
-            fill_count_ = head_ - offset;
+        if ( offset >= 0 && offset <= (int64_t) head_ ) { // note <= is needed to place SEEK_END past last byte
+            tail_ = (size_t) offset;
+            fill_count_ = head_ - (size_t) offset;
             rv = 0;
         }
     }
@@ -211,19 +390,19 @@ inline int osal::posix::CircularBuffer::Seek (int64_t a_offset, int a_whence)
  * @brief Return the current read offset of seekable stream in memory
  * @return The current offset in the tream or -1 on error
  */
-inline long int osal::posix::CircularBuffer::Tell () const
+inline int64_t osal::posix::CircularBuffer::Tell () const
 {
     if ( true == seekable_ ) {
-        return tail_;
+        return (int64_t) tail_;
     } else {
         return -1;
     }
 }
 
-inline int osal::posix::CircularBuffer::SeekableReadSize () const
+inline int64_t osal::posix::CircularBuffer::SeekableReadSize () const
 {
     if ( true == seekable_ ) {
-        return head_;
+        return (int64_t) head_;
     } else {
         return -1;
     }
@@ -246,4 +425,57 @@ inline bool osal::posix::CircularBuffer::IsOperational ()
     }
 }
 
+/**
+ * @brief Sleep until at least the given number of bytes is ready for reading
+ *
+ * @param a_min_bytes  Number of bytes required
+ * @param a_timeout_ms Maximum time to wait in milliseconds, -1 to wait forever
+ * @return true if the bytes are available, false on timeout
+ */
+inline bool osal::posix::CircularBuffer::WaitForReadable (size_t a_min_bytes, int64_t a_timeout_ms)
+{
+    if ( fill_count_ >= a_min_bytes ) {
+        return true;
+    }
+    return Wait(&read_threshold_, a_min_bytes, true, a_timeout_ms);
+}
+
+/**
+ * @brief Sleep until at least the given number of bytes is free for writing
+ *
+ * @param a_min_bytes  Number of bytes required
+ * @param a_timeout_ms Maximum time to wait in milliseconds, -1 to wait forever
+ * @return true if the space is available, false on timeout
+ */
+inline bool osal::posix::CircularBuffer::WaitForWritable (size_t a_min_bytes, int64_t a_timeout_ms)
+{
+    if ( length_ - fill_count_ >= a_min_bytes ) {
+        return true;
+    }
+    return Wait(&write_threshold_, a_min_bytes, false, a_timeout_ms);
+}
+
+/**
+ * @return The event file descriptor created by #EnableEventFd, or -1
+ */
+inline int osal::posix::CircularBuffer::GetEventFd () const
+{
+    return event_fd_;
+}
+
+/**
+ * @brief Copy the occupancy and stall counters, zeros unless built with ENABLE_CIRCULAR_BUFFER_STATS
+ *
+ * @param o_stats On output, the counters
+ */
+inline void osal::posix::CircularBuffer::GetStats (CircularBufferStats& o_stats) const
+{
+    counters_.Snapshot(o_stats);
+}
+
+inline void osal::posix::CircularBuffer::ResetStats ()
+{
+    counters_.Reset();
+}
+
 #endif // NRS_OSAL_POSIX_POSIX_CIRCULARBUFFER_H
@@ -27,6 +27,8 @@
 #include <unistd.h>   // for close, ftruncate
 #include <fcntl.h>    // for open
 #include <stdio.h>    // Temporary
+#include <errno.h>    // for errno
+#include <sys/uio.h>  // for readv, writev
 
 #ifdef __ANDROID__
 #undef perror
@@ -41,13 +43,14 @@ void osal::posix::CircularBufferNoMmap::Init ()
     head_       = 0;
     fill_count_ = 0;
     seekable_   = true;
+    reserved_skip_ = 0;
 }
 
-void osal::posix::CircularBufferNoMmap::Trace (const char* a_tag, int32_t a_amount)
+void osal::posix::CircularBufferNoMmap::Trace (const char* a_tag, size_t a_amount)
 {
     OSAL_UNUSED_PARAM(a_tag);
     OSAL_UNUSED_PARAM(a_amount);
-    DEBUGTRACE("CBF", "%10.10s H=%10.10d T=%10.10d FC=%8.8d S=%c A=%d", a_tag, head_, tail_, fill_count_, seekable_ ? 'T' : 'F', a_amount);
+    DEBUGTRACE("CBF", "%10.10s H=%10.10zu T=%10.10zu FC=%8.8zu S=%c A=%zu", a_tag, head_, tail_, (size_t) fill_count_, seekable_ ? 'T' : 'F', a_amount);
 }
 
 /**
@@ -55,7 +58,7 @@ void osal::posix::CircularBufferNoMmap::Trace (const char* a_tag, int32_t a_amou
  *
  * @param a_length Length of buffer
  */
-bool osal::posix::CircularBufferNoMmap::Init (const char*, int32_t a_length)
+bool osal::posix::CircularBufferNoMmap::Init (const char*, size_t a_length)
 {
     buffer_ = malloc(a_length);
     if ( buffer_ != NULL ) {
@@ -90,7 +93,7 @@ void osal::posix::CircularBufferNoMmap::Close ()
  */
 void osal::posix::CircularBufferNoMmap::Clear ()
 {
-    __sync_add_and_fetch(&fill_count_, -fill_count_);
+    __sync_sub_and_fetch(&fill_count_, fill_count_);
     head_ = 0;
     tail_ = 0;
     seekable_ = true;
@@ -98,3 +101,62 @@ void osal::posix::CircularBufferNoMmap::Clear ()
         Trace("Clear", 0);
     }
 }
+
+/**
+ * @brief Read from a descriptor straight into the free space of the buffer
+ *
+ *  The free space is handed to readv(2) as (at most) two segments, before and after the wrap around.
+ *
+ * @param a_fd        Descriptor to read from
+ * @param a_max_bytes Maximum number of bytes to read
+ * @return Number of bytes produced, 0 on end of file, -1 on error ( errno is ENOBUFS when the buffer is full )
+ */
+ssize_t osal::posix::CircularBufferNoMmap::ProduceFromFd (int a_fd, size_t a_max_bytes)
+{
+    struct iovec iov[2];
+    if ( 0 == PeekWritable(iov) || 0 == a_max_bytes ) {
+        OSAL_CIRCULAR_BUFFER_STATS(if ( 0 != a_max_bytes ) counters_.Full());
+        errno = ENOBUFS;
+        return -1;
+    }
+    iov[0].iov_len = MIN(iov[0].iov_len, a_max_bytes);
+    iov[1].iov_len = MIN(iov[1].iov_len, a_max_bytes - iov[0].iov_len);
+
+    ssize_t rv;
+    do {
+        rv = readv(a_fd, iov, 0 != iov[1].iov_len ? 2 : 1);
+    } while ( -1 == rv && EINTR == errno );
+    if ( rv > 0 ) {
+        CommitWrite((size_t) rv);
+    }
+    return rv;
+}
+
+/**
+ * @brief Write the buffered bytes straight to a descriptor
+ *
+ *  The used space is handed to writev(2) as (at most) two segments, before and after the wrap around.
+ *
+ * @param a_fd        Descriptor to write to
+ * @param a_max_bytes Maximum number of bytes to write
+ * @return Number of bytes consumed, 0 when the buffer is empty, -1 on error
+ */
+ssize_t osal::posix::CircularBufferNoMmap::ConsumeToFd (int a_fd, size_t a_max_bytes)
+{
+    struct iovec iov[2];
+    if ( 0 == PeekReadable(iov) || 0 == a_max_bytes ) {
+        OSAL_CIRCULAR_BUFFER_STATS(if ( 0 != a_max_bytes ) counters_.Empty());
+        return 0;
+    }
+    iov[0].iov_len = MIN(iov[0].iov_len, a_max_bytes);
+    iov[1].iov_len = MIN(iov[1].iov_len, a_max_bytes - iov[0].iov_len);
+
+    ssize_t rv;
+    do {
+        rv = writev(a_fd, iov, 0 != iov[1].iov_len ? 2 : 1);
+    } while ( -1 == rv && EINTR == errno );
+    if ( rv > 0 ) {
+        CommitRead((size_t) rv);
+    }
+    return rv;
+}
@@ -25,9 +25,13 @@
 #define NRS_OSAL_POSIX_CIRCULAR_BUFFER_NO_MMAP_H
 #include "osal/osalite.h"
 #include "osal/debug_trace.h"
+#include "osal/posix/posix_circular_buffer_stats.h"
 
 #include <stdint.h>
 #include <stdlib.h>   // for NULL
+#include <stddef.h>   // for size_t
+#include <sys/types.h> // for ssize_t
+#include <sys/uio.h>   // for struct iovec
 #include <sys/mman.h> // for mmap
 
 namespace osal
@@ -39,46 +43,76 @@ namespace osal
         protected: // data
 
             void*             buffer_;
-            int32_t           length_;
-            int32_t           tail_;
-            int32_t           contiguous_readable_bytes_;
-            int32_t           head_;
-            int32_t           contiguous_writable_bytes_;
+            size_t            length_;
+            size_t            tail_;
+            size_t            contiguous_readable_bytes_;
+            size_t            head_;
+            size_t            contiguous_writable_bytes_;
             bool              seekable_;
-            volatile int32_t  fill_count_;
+            volatile size_t   fill_count_;
+            size_t            reserved_skip_; //!< Bytes left unused at the end by the pending #ReserveRecord
+            CircularBufferCounters counters_; //!< Only updated with ENABLE_CIRCULAR_BUFFER_STATS
+
+        public: // Const Data
+
+            static const size_t   k_record_header_size_ = sizeof(uint64_t);    //!< Length prefix of each record
+            static const uint64_t k_record_wrap_marker_ = UINT64_MAX;          //!< Prefix of the unused bytes at the end
 
         public: // methods
 
             CircularBufferNoMmap ();
             virtual ~CircularBufferNoMmap ();
 
-            bool  Init      (const char* a_data_path, int32_t a_length);
+            bool  Init      (const char* a_data_path, size_t a_length);
             void  Clear     ();
             void  Close     ();
 
         public: // methods
 
             // Reading (consuming)
-            int32_t ReadableBytes  ();
-            void    Read           (void* a_dst, int32_t a_amount);
+            size_t  ReadableBytes  ();
+            void    Read           (void* a_dst, size_t a_amount);
 
             // Writing (producing)
-            int32_t WritableBytes  ();
-            void    Write          (void* a_src, int32_t a_amount);
+            size_t  WritableBytes  ();
+            void    Write          (void* a_src, size_t a_amount);
+
+            // In place access, up to two spans ( before and after the wrap around ), second span empty when not needed
+            size_t  PeekReadable   (struct iovec o_spans[2]) const;
+            void    CommitRead     (size_t a_amount);
+            size_t  PeekWritable   (struct iovec o_spans[2]) const;
+            void    CommitWrite    (size_t a_amount);
+
+            // Direct descriptor I/O over the two free / used segments, no intermediate copy
+            ssize_t ProduceFromFd  (int a_fd, size_t a_max_bytes);
+            ssize_t ConsumeToFd    (int a_fd, size_t a_max_bytes);
+
+            // Framed records, always contiguous (do not mix with Read / Write on the same buffer)
+            void*       ReserveRecord  (size_t  a_length);
+            void        CommitRecord   (size_t  a_length);
+            const void* PeekRecord     (size_t* o_length);
+            void        ReleaseRecord  ();
+
+            static size_t RecordSize   (size_t a_length);
 
             // Seek mode for random access (*not* thread safe)
-            int32_t  Size              () const;
+            size_t   Size              () const;
             int      Seek              (int64_t a_offset, int a_whence);
-            long int Tell              () const;
+            int64_t  Tell              () const;
             bool     IsSeekable        () const;
-            int      SeekableReadSize  () const;
+            int64_t  SeekableReadSize  () const;
             bool     IsOperational     () const;
-            bool     HeadWrapsArround  (int32_t a_requested_bytes) const;
-            void     Trace             (const char* a_tag, int32_t a_amount);
+            bool     HeadWrapsArround  (size_t a_requested_bytes) const;
+            void     Trace             (const char* a_tag, size_t a_amount);
+
+            // Instrumentation, see posix_circular_buffer_stats.h
+            void     GetStats          (CircularBufferStats& o_stats) const;
+            void     ResetStats        ();
 
         protected:
 
-            void  Init    ();
+            void    Init         ();
+            size_t  RecordSkip   (size_t a_position) const;
 
         };
 
@@ -95,7 +129,7 @@ inline osal::posix::CircularBufferNoMmap::~CircularBufferNoMmap ()
     Close();
 }
 
-inline int32_t osal::posix::CircularBufferNoMmap::Size () const
+inline size_t osal::posix::CircularBufferNoMmap::Size () const
 {
     return length_;
 }
@@ -109,12 +143,13 @@ inline int32_t osal::posix::CircularBufferNoMmap::Size () const
  * @param o_available_bytes On output, the number of bytes ready for reading
  * @return Pointer to the first bytes ready for reading, or NULL if buffer is empty
  */
-inline int32_t osal::posix::CircularBufferNoMmap::ReadableBytes ()
+inline size_t osal::posix::CircularBufferNoMmap::ReadableBytes ()
 {
-    int32_t fc = fill_count_;
+    size_t fc = fill_count_;
 
     if ( fc == 0 ) {
         contiguous_readable_bytes_ = 0;
+        OSAL_CIRCULAR_BUFFER_STATS(counters_.Empty());
         DEBUGIF("CBF") {
             Trace("Tail", 0);
         }
@@ -140,7 +175,7 @@ inline int32_t osal::posix::CircularBufferNoMmap::ReadableBytes ()
  *
  * @param a_amount Number of bytes to consume
  */
-inline void osal::posix::CircularBufferNoMmap::Read (void* a_dst, int32_t a_amount)
+inline void osal::posix::CircularBufferNoMmap::Read (void* a_dst, size_t a_amount)
 {
     if ( contiguous_readable_bytes_ == 0 ) {
         return;
@@ -148,13 +183,18 @@ inline void osal::posix::CircularBufferNoMmap::Read (void* a_dst, int32_t a_amou
     if ( a_amount <=  contiguous_readable_bytes_ ) {
         memcpy(a_dst, (uint8_t*) buffer_ + tail_, a_amount);
         tail_ += a_amount;
+        if ( tail_ == length_ ) {
+            tail_     = 0;
+            seekable_ = false;
+        }
     } else {
         memcpy(a_dst, (uint8_t*) buffer_ + tail_, contiguous_readable_bytes_);
         memcpy((uint8_t*) a_dst + contiguous_readable_bytes_, buffer_, a_amount - contiguous_readable_bytes_);
         tail_     = a_amount - contiguous_readable_bytes_;
         seekable_ = false;
     }
-    __sync_add_and_fetch(&fill_count_, -a_amount);
+    __sync_sub_and_fetch(&fill_count_, a_amount);
+    OSAL_CIRCULAR_BUFFER_STATS(counters_.Consumed(a_amount));
 }
 
 /**
@@ -167,12 +207,13 @@ inline void osal::posix::CircularBufferNoMmap::Read (void* a_dst, int32_t a_amou
  * @param o_total_free_bytes On output, the total free space in the buffer
  * @return Pointer to the first bytes ready for writing, or NULL if buffer is full
  */
-inline int32_t osal::posix::CircularBufferNoMmap::WritableBytes ()
+inline size_t osal::posix::CircularBufferNoMmap::WritableBytes ()
 {
-    int32_t fc = fill_count_;
+    size_t fc = fill_count_;
 
     if ( fc == length_ ) {
         contiguous_writable_bytes_ = 0;
+        OSAL_CIRCULAR_BUFFER_STATS(counters_.Full());
         DEBUGIF("CBF") {
             Trace("Head", 0);
         }
@@ -191,7 +232,7 @@ inline int32_t osal::posix::CircularBufferNoMmap::WritableBytes ()
     return length_ - fc;
 }
 
-inline void osal::posix::CircularBufferNoMmap::Write (void* a_src, int32_t a_amount)
+inline void osal::posix::CircularBufferNoMmap::Write (void* a_src, size_t a_amount)
 {
     if ( contiguous_writable_bytes_ == 0 ) {
         return;
@@ -199,6 +240,10 @@ inline void osal::posix::CircularBufferNoMmap::Write (void* a_src, int32_t a_amo
     if ( a_amount <=  contiguous_writable_bytes_ ) {
         memcpy((uint8_t*) buffer_ + head_, a_src, a_amount);
         head_ += a_amount;
+        if ( head_ == length_ ) {
+            head_     = 0;
+            seekable_ = false;
+        }
     } else {
         memcpy((uint8_t*) buffer_ + head_, a_src, contiguous_writable_bytes_);
         memcpy(buffer_, (uint8_t*) a_src + contiguous_writable_bytes_, a_amount - contiguous_writable_bytes_);
@@ -206,8 +251,180 @@ inline void osal::posix::CircularBufferNoMmap::Write (void* a_src, int32_t a_amo
         seekable_ = false;
     }
     __sync_add_and_fetch(&fill_count_, a_amount);
+    // ... the new head is behind the amount only when the write crossed the end ...
+    OSAL_CIRCULAR_BUFFER_STATS(counters_.Produced(a_amount, fill_count_, head_ < a_amount));
+}
+
+/**
+ * @brief Access the bytes ready for reading in place
+ *
+ * @param o_spans On output, pointer and length of the bytes before and after the wrap around
+ * @return Total number of bytes ready for reading
+ */
+inline size_t osal::posix::CircularBufferNoMmap::PeekReadable (struct iovec o_spans[2]) const
+{
+    const size_t fc    = fill_count_;
+    const size_t first = MIN(fc, length_ - tail_);
+
+    o_spans[0].iov_base = (uint8_t*) buffer_ + tail_;
+    o_spans[0].iov_len  = first;
+    o_spans[1].iov_base = buffer_;
+    o_spans[1].iov_len  = fc - first;
+    return fc;
 }
 
+/**
+ * @brief Free bytes read in place with #PeekReadable
+ *
+ * @param a_amount Number of bytes to consume, must not exceed the peeked total
+ */
+inline void osal::posix::CircularBufferNoMmap::CommitRead (size_t a_amount)
+{
+    const size_t tail = tail_ + a_amount;
+    if ( tail >= length_ ) {
+        tail_     = tail - length_;
+        seekable_ = false;
+    } else {
+        tail_ = tail;
+    }
+    __sync_sub_and_fetch(&fill_count_, a_amount);
+    OSAL_CIRCULAR_BUFFER_STATS(counters_.Consumed(a_amount));
+}
+
+/**
+ * @brief Access the free bytes in place
+ *
+ * @param o_spans On output, pointer and length of the free bytes before and after the wrap around
+ * @return Total number of free bytes
+ */
+inline size_t osal::posix::CircularBufferNoMmap::PeekWritable (struct iovec o_spans[2]) const
+{
+    const size_t free_bytes = length_ - fill_count_;
+    const size_t first      = MIN(free_bytes, length_ - head_);
+
+    o_spans[0].iov_base = (uint8_t*) buffer_ + head_;
+    o_spans[0].iov_len  = first;
+    o_spans[1].iov_base = buffer_;
+    o_spans[1].iov_len  = free_bytes - first;
+    return free_bytes;
+}
+
+/**
+ * @brief Publish bytes written in place with #PeekWritable
+ *
+ * @param a_amount Number of bytes to produce, must not exceed the peeked total
+ */
+inline void osal::posix::CircularBufferNoMmap::CommitWrite (size_t a_amount)
+{
+    const size_t head = head_ + a_amount;
+    if ( head >= length_ ) {
+        head_     = head - length_;
+        seekable_ = false;
+    } else {
+        head_ = head;
+    }
+    __sync_add_and_fetch(&fill_count_, a_amount);
+    OSAL_CIRCULAR_BUFFER_STATS(counters_.Produced(a_amount, fill_count_, head_ < a_amount));
+}
+
+/**
+ * @brief Bytes used in the buffer by a record, prefix and padding included
+ *
+ * @param a_length Payload length
+ */
+inline size_t osal::posix::CircularBufferNoMmap::RecordSize (size_t a_length)
+{
+    return k_record_header_size_ + ((a_length + 7) & ~((size_t) 7));
+}
+
+/**
+ * @brief Number of bytes to skip, at the given position, to reach the next record
+ *
+ *  A record never wraps around: when it does not fit before the end of the buffer the
+ *  producer leaves the remaining bytes unused, marked with #k_record_wrap_marker_ if there
+ *  is room for it.
+ */
+inline size_t osal::posix::CircularBufferNoMmap::RecordSkip (size_t a_position) const
+{
+    const size_t remaining = length_ - a_position;
+    if ( remaining < k_record_header_size_ || k_record_wrap_marker_ == *(const uint64_t*) ((const uint8_t*) buffer_ + a_position) ) {
+        return remaining;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reserve a contiguous record at the front of the buffer
+ *
+ *  Nothing is visible to the consumer until #CommitRecord.
+ *
+ * @param a_length Maximum payload length
+ * @return Pointer to the payload, or NULL if there is not enough space
+ */
+inline void* osal::posix::CircularBufferNoMmap::ReserveRecord (size_t a_length)
+{
+    const size_t size = RecordSize(a_length);
+    const size_t skip = ( head_ + size > length_ ) ? length_ - head_ : 0;
+    if ( skip + size > length_ - fill_count_ ) {
+        OSAL_CIRCULAR_BUFFER_STATS(counters_.Full());
+        return NULL;
+    }
+    reserved_skip_ = skip;
+    if ( skip >= k_record_header_size_ ) {
+        *(uint64_t*) ((uint8_t*) buffer_ + head_) = k_record_wrap_marker_;
+    }
+    return (uint8_t*) buffer_ + ( 0 != skip ? 0 : head_ ) + k_record_header_size_;
+}
+
+/**
+ * @brief Publish the record obtained with #ReserveRecord
+ *
+ * @param a_length Payload length, must not exceed the reserved length
+ */
+inline void osal::posix::CircularBufferNoMmap::CommitRecord (size_t a_length)
+{
+    const size_t size = RecordSize(a_length);
+    if ( 0 != reserved_skip_ ) {
+        head_     = 0;
+        seekable_ = false;
+    }
+    *(uint64_t*) ((uint8_t*) buffer_ + head_) = (uint64_t) a_length;
+    head_ = ( head_ + size ) % length_;
+    __sync_add_and_fetch(&fill_count_, reserved_skip_ + size);
+    OSAL_CIRCULAR_BUFFER_STATS(counters_.Produced(reserved_skip_ + size, fill_count_, head_ < reserved_skip_ + size));
+}
+
+/**
+ * @brief Access the oldest record
+ *
+ * @param o_length On output, the payload length
+ * @return Pointer to the contiguous payload, or NULL if there is no record
+ */
+inline const void* osal::posix::CircularBufferNoMmap::PeekRecord (size_t* o_length)
+{
+    if ( 0 == fill_count_ ) {
+        *o_length = 0;
+        return NULL;
+    }
+    const size_t position = ( 0 != RecordSkip(tail_) ) ? 0 : tail_;
+    *o_length = (size_t) *(const uint64_t*) ((const uint8_t*) buffer_ + position);
+    return (const uint8_t*) buffer_ + position + k_record_header_size_;
+}
+
+/**
+ * @brief Release the record returned by #PeekRecord
+ */
+inline void osal::posix::CircularBufferNoMmap::ReleaseRecord ()
+{
+    const size_t skip = RecordSkip(tail_);
+    if ( 0 != skip ) {
+        tail_ = 0;
+    }
+    const size_t size = RecordSize((size_t) *(const uint64_t*) ((const uint8_t*) buffer_ + tail_));
+    tail_ = ( tail_ + size ) % length_;
+    __sync_sub_and_fetch(&fill_count_, skip + size);
+    OSAL_CIRCULAR_BUFFER_STATS(counters_.Consumed(skip + size));
+}
 
 /**
  * @brief Seek inside the buffer, buffer must be seekable and this is *NOT* thread safe
@@ -225,22 +442,22 @@ inline int osal::posix::CircularBufferNoMmap::Seek (int64_t a_offset, int a_when
 
     // Americo! can't be called before all bytes are in buffer
     if ( true == seekable_ ) {
-        int32_t offset = -1;
+        int64_t offset = -1;
 
         switch(a_whence) {
             case SEEK_SET:
-                offset = (int32_t) a_offset;
+                offset = a_offset;
                 break;
             case SEEK_CUR:
-                offset = tail_ + (int32_t) a_offset;
+                offset = (int64_t) tail_ + a_offset;
                 break;
             case SEEK_END:
-                offset = head_ - (int32_t) a_offset;
+                offset = (int64_t) head_ - a_offset;
                 break;
         }
-        if ( offset >= 0 && offset <= (int32_t) head_ ) { // note <= is needed to place SEEK_END past last byte
-            tail_ = offset;
-            fill_count_ = head_ - offset;
+        if ( offset >= 0 && offset <= (int64_t) head_ ) { // note <= is needed to place SEEK_END past last byte
+            tail_ = (size_t) offset;
+            fill_count_ = head_ - (size_t) offset;
             rv = 0;
         }
     }
@@ -251,19 +468,19 @@ inline int osal::posix::CircularBufferNoMmap::Seek (int64_t a_offset, int a_when
  * @brief Return the current read offset of seekable stream in memory
  * @return The current offset in the tream or -1 on error
  */
-inline long int osal::posix::CircularBufferNoMmap::Tell () const
+inline int64_t osal::posix::CircularBufferNoMmap::Tell () const
 {
     if ( true == seekable_ ) {
-        return tail_;
+        return (int64_t) tail_;
     } else {
         return -1;
     }
 }
 
-inline int osal::posix::CircularBufferNoMmap::SeekableReadSize () const
+inline int64_t osal::posix::CircularBufferNoMmap::SeekableReadSize () const
 {
     if ( true == seekable_ ) {
-        return head_;
+        return (int64_t) head_;
     } else {
         return -1;
     }
@@ -278,7 +495,22 @@ inline bool osal::posix::CircularBufferNoMmap::IsOperational () const
     }
 }
 
-inline bool osal::posix::CircularBufferNoMmap::HeadWrapsArround (int32_t a_requested_bytes) const
+/**
+ * @brief Copy the occupancy and stall counters, zeros unless built with ENABLE_CIRCULAR_BUFFER_STATS
+ *
+ * @param o_stats On output, the counters
+ */
+inline void osal::posix::CircularBufferNoMmap::GetStats (CircularBufferStats& o_stats) const
+{
+    counters_.Snapshot(o_stats);
+}
+
+inline void osal::posix::CircularBufferNoMmap::ResetStats ()
+{
+    counters_.Reset();
+}
+
+inline bool osal::posix::CircularBufferNoMmap::HeadWrapsArround (size_t a_requested_bytes) const
 {
     if ( head_ + a_requested_bytes > length_) {
         return true;
@@ -0,0 +1,166 @@
+#pragma once
+/**
+ * @file posix_circular_buffer_stats.h Occupancy and stall counters of the circular buffers - header only
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * The counters are only updated when built with ENABLE_CIRCULAR_BUFFER_STATS, otherwise the
+ * updates compile to nothing and snapshots read zeros. The counters themselves are always part
+ * of the buffers, so the library and its clients may be built with different settings.
+ *
+ * Each counter has a single writer, the producer or the consumer, on its own cache line.
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_CIRCULAR_BUFFER_STATS_H
+#define NRS_OSAL_POSIX_POSIX_CIRCULAR_BUFFER_STATS_H
+
+#include <stdint.h>
+#include <stddef.h> // for size_t
+
+#if defined(ENABLE_CIRCULAR_BUFFER_STATS)
+    #define OSAL_CIRCULAR_BUFFER_STATS(statement) statement
+#else
+    #define OSAL_CIRCULAR_BUFFER_STATS(statement)
+#endif
+
+namespace osal
+{
+    namespace posix
+    {
+
+        /**
+         * @brief Snapshot of the counters of one buffer.
+         */
+        typedef struct {
+            uint64_t high_water_mark_; //!< Highest fill count seen by the producer
+            uint64_t full_events_;     //!< Times the producer found less space than it needed
+            uint64_t empty_events_;    //!< Times the consumer found the buffer empty
+            uint64_t bytes_produced_;
+            uint64_t bytes_consumed_;
+            uint64_t wrap_arounds_;    //!< Times the write position crossed the end of the buffer
+        } CircularBufferStats;
+
+        class CircularBufferCounters
+        {
+
+        protected: // data
+
+            alignas(64) uint64_t high_water_mark_;
+                        uint64_t full_events_;
+                        uint64_t bytes_produced_;
+                        uint64_t wrap_arounds_;
+            alignas(64) uint64_t empty_events_;
+                        uint64_t bytes_consumed_;
+
+        public: // methods
+
+            CircularBufferCounters ();
+
+            // Producer
+            void  Produced (size_t a_amount, size_t a_fill_count, bool a_wrapped);
+            void  Full     ();
+
+            // Consumer
+            void  Consumed (size_t a_amount);
+            void  Empty    ();
+
+            // Any thread
+            void  Snapshot (CircularBufferStats& o_stats) const;
+            void  Reset    ();
+
+        protected:
+
+            static void Add (uint64_t& a_counter, uint64_t a_amount);
+
+        };
+
+    } // endof namespace posix
+} // endof namespace osal
+
+inline osal::posix::CircularBufferCounters::CircularBufferCounters ()
+{
+    Reset();
+}
+
+/**
+ * @brief Single writer increment, readers only need to see a whole value
+ */
+inline void osal::posix::CircularBufferCounters::Add (uint64_t& a_counter, uint64_t a_amount)
+{
+    __atomic_store_n(&a_counter, __atomic_load_n(&a_counter, __ATOMIC_RELAXED) + a_amount, __ATOMIC_RELAXED);
+}
+
+/**
+ * @param a_amount     Number of bytes produced
+ * @param a_fill_count Fill count after the bytes were produced
+ * @param a_wrapped    true if the write position crossed the end of the buffer
+ */
+inline void osal::posix::CircularBufferCounters::Produced (size_t a_amount, size_t a_fill_count, bool a_wrapped)
+{
+    Add(bytes_produced_, (uint64_t) a_amount);
+    if ( (uint64_t) a_fill_count > high_water_mark_ ) {
+        __atomic_store_n(&high_water_mark_, (uint64_t) a_fill_count, __ATOMIC_RELAXED);
+    }
+    if ( true == a_wrapped ) {
+        Add(wrap_arounds_, 1);
+    }
+}
+
+inline void osal::posix::CircularBufferCounters::Full ()
+{
+    Add(full_events_, 1);
+}
+
+inline void osal::posix::CircularBufferCounters::Consumed (size_t a_amount)
+{
+    Add(bytes_consumed_, (uint64_t) a_amount);
+}
+
+inline void osal::posix::CircularBufferCounters::Empty ()
+{
+    Add(empty_events_, 1);
+}
+
+/**
+ * @brief Copy the counters, each one is consistent on its own
+ *
+ * @param o_stats On output, the counters
+ */
+inline void osal::posix::CircularBufferCounters::Snapshot (CircularBufferStats& o_stats) const
+{
+    o_stats.high_water_mark_ = __atomic_load_n(&high_water_mark_, __ATOMIC_RELAXED);
+    o_stats.full_events_     = __atomic_load_n(&full_events_    , __ATOMIC_RELAXED);
+    o_stats.empty_events_    = __atomic_load_n(&empty_events_   , __ATOMIC_RELAXED);
+    o_stats.bytes_produced_  = __atomic_load_n(&bytes_produced_ , __ATOMIC_RELAXED);
+    o_stats.bytes_consumed_  = __atomic_load_n(&bytes_consumed_ , __ATOMIC_RELAXED);
+    o_stats.wrap_arounds_    = __atomic_load_n(&wrap_arounds_   , __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Zero the counters, racy against a concurrent producer or consumer
+ */
+inline void osal::posix::CircularBufferCounters::Reset ()
+{
+    high_water_mark_ = 0;
+    full_events_     = 0;
+    bytes_produced_  = 0;
+    wrap_arounds_    = 0;
+    empty_events_    = 0;
+    bytes_consumed_  = 0;
+}
+
+#endif // NRS_OSAL_POSIX_POSIX_CIRCULAR_BUFFER_STATS_H
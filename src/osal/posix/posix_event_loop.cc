@@ -0,0 +1,341 @@
+/**
+ * @file posix_event_loop.cc - epoll based event loop, implementation
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper-osal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(__linux__) // ... epoll, eventfd and timerfd only ...
+
+#include "osal/posix/posix_event_loop.h"
+
+#include <errno.h>
+#include <stdio.h>         // perror
+#include <unistd.h>        // read, write, close
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+osal::posix::EventLoop::EventLoop ()
+{
+    woken_            = 0;
+    stop_             = false;
+    timer_generation_ = 0;
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if ( -1 == epoll_fd_ ) {
+        perror("epoll_create1");
+    }
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ( -1 == wake_fd_ ) {
+        perror("eventfd");
+    }
+    pthread_mutex_init(&posted_mutex_, NULL);
+
+    if ( -1 != epoll_fd_ && -1 != wake_fd_ ) {
+        struct epoll_event event;
+        event.events   = EPOLLIN | EPOLLET;
+        event.data.ptr = NULL; // ... tells the wake-ups apart from the watches ...
+        if ( 0 != epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) ) {
+            perror("epoll_ctl");
+            close(wake_fd_);
+            wake_fd_ = -1;
+        }
+    }
+}
+
+osal::posix::EventLoop::~EventLoop ()
+{
+    for ( auto it : entries_ ) {
+        if ( true == it.second->timer_ ) {
+            close(it.first);
+        }
+        delete it.second;
+    }
+    for ( auto entry : retired_ ) {
+        delete entry;
+    }
+    if ( -1 != wake_fd_ ) {
+        close(wake_fd_);
+    }
+    if ( -1 != epoll_fd_ ) {
+        close(epoll_fd_);
+    }
+    pthread_mutex_destroy(&posted_mutex_);
+}
+
+/**
+ * @brief Watch a descriptor, it should be non blocking
+ *
+ * @param a_fd       Descriptor to watch, not owned by the loop
+ * @param a_events   #Readable and / or #Writable, or any EPOLL* event
+ * @param a_callback Called from the loop thread with the events that fired
+ *
+ * @return false if the descriptor is already watched or epoll refused it
+ */
+bool osal::posix::EventLoop::Watch (int a_fd, uint32_t a_events, const Callback& a_callback)
+{
+    return Add(a_fd, a_events, false, a_callback);
+}
+
+/**
+ * @brief Watch a datagram socket, see #Watch(int, uint32_t, const Callback&)
+ */
+bool osal::posix::EventLoop::Watch (const DatagramSocket& a_socket, uint32_t a_events, const Callback& a_callback)
+{
+    return Add(a_socket.GetFileDescriptor(), a_events, false, a_callback);
+}
+
+/**
+ * @brief Watch an open file, see #Watch(int, uint32_t, const Callback&)
+ */
+bool osal::posix::EventLoop::Watch (File& a_file, uint32_t a_events, const Callback& a_callback)
+{
+    int fd = -1;
+    if ( osal::BaseFile::EStatusOk != a_file.GetDescriptor(&fd) ) {
+        return false;
+    }
+    return Add(fd, a_events, false, a_callback);
+}
+
+/**
+ * @brief Stop watching a descriptor, the descriptor is left open
+ *
+ * @param a_fd Descriptor given to #Watch
+ *
+ * @return false if the descriptor was not watched
+ */
+bool osal::posix::EventLoop::Unwatch (int a_fd)
+{
+    return Remove(a_fd, false);
+}
+
+/**
+ * @brief Arm a timer
+ *
+ * @param a_delay_ms  Milliseconds until the first firing, 0 fires on the next iteration
+ * @param a_task      Task to run on the loop thread
+ * @param a_period_ms Milliseconds between firings, 0 for a one shot timer
+ *
+ * @return Timer id, #k_invalid_timer_ on failure
+ */
+osal::posix::EventLoop::TimerId osal::posix::EventLoop::AddTimer (uint64_t a_delay_ms, const Task& a_task, uint64_t a_period_ms)
+{
+    const int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if ( -1 == fd ) {
+        return k_invalid_timer_;
+    }
+
+    struct itimerspec spec;
+    spec.it_value.tv_sec     = (time_t) ( a_delay_ms / 1000 );
+    spec.it_value.tv_nsec    = (long) ( a_delay_ms % 1000 ) * 1000000;
+    spec.it_interval.tv_sec  = (time_t) ( a_period_ms / 1000 );
+    spec.it_interval.tv_nsec = (long) ( a_period_ms % 1000 ) * 1000000;
+    if ( 0 == a_delay_ms ) {
+        spec.it_value.tv_nsec = 1; // ... zero would disarm the timer ...
+    }
+    if ( 0 != timerfd_settime(fd, 0, &spec, NULL) ) {
+        close(fd);
+        return k_invalid_timer_;
+    }
+
+    const bool periodic = 0 != a_period_ms;
+    if ( false == Add(fd, EPOLLIN, true, [this, fd, periodic, a_task] (uint32_t /* a_events */) {
+        uint64_t expirations;
+        if ( sizeof(expirations) != read(fd, &expirations, sizeof(expirations)) ) {
+            return; // ... EAGAIN, nothing expired ...
+        }
+        if ( false == periodic ) {
+            // ... the entry, and this callback, live until the end of the batch ...
+            Remove(fd, true);
+        }
+        a_task();
+    }) ) {
+        close(fd);
+        return k_invalid_timer_;
+    }
+    // ... the descriptor is reused once the timer is gone, the generation tells them apart ...
+    if ( 0 == ++timer_generation_ ) {
+        timer_generation_ = 1;
+    }
+    entries_[fd]->generation_ = timer_generation_;
+    return ( (TimerId) timer_generation_ << 32 ) | (TimerId) (uint32_t) fd;
+}
+
+/**
+ * @brief Disarm a timer
+ *
+ * @param a_timer Id returned by #AddTimer
+ *
+ * @return false if the timer already fired or was cancelled
+ */
+bool osal::posix::EventLoop::CancelTimer (TimerId a_timer)
+{
+    const int fd  = (int) (uint32_t) ( a_timer & 0xFFFFFFFF );
+    const auto it = entries_.find(fd);
+    if ( entries_.end() == it || false == it->second->timer_ || (uint32_t) ( a_timer >> 32 ) != it->second->generation_ ) {
+        return false;
+    }
+    return Remove(fd, true);
+}
+
+/**
+ * @brief Queue a task for the loop thread, may be called from any thread
+ *
+ * @param a_task Task to run
+ */
+void osal::posix::EventLoop::Post (const Task& a_task)
+{
+    pthread_mutex_lock(&posted_mutex_);
+    posted_.push_back(a_task);
+    pthread_mutex_unlock(&posted_mutex_);
+
+    // ... one write per loop iteration at most ...
+    if ( 0 == __atomic_exchange_n(&woken_, 1, __ATOMIC_SEQ_CST) ) {
+        const uint64_t one = 1;
+        (void) write(wake_fd_, &one, sizeof(one));
+    }
+}
+
+/**
+ * @brief Wait for events and dispatch them
+ *
+ * @param a_timeout_ms Maximum time to wait, -1 to wait until something happens
+ *
+ * @return Number of events dispatched, -1 on error
+ */
+int osal::posix::EventLoop::RunOnce (int a_timeout_ms)
+{
+    const int count = epoll_wait(epoll_fd_, events_, k_max_events_, a_timeout_ms);
+    if ( -1 == count ) {
+        return EINTR == errno ? 0 : -1;
+    }
+
+    for ( int i = 0; i < count; ++i ) {
+        Entry* entry = (Entry*) events_[i].data.ptr;
+        if ( NULL == entry ) {
+            // ... cleared before the read, a Post that follows writes again ...
+            __atomic_store_n(&woken_, 0, __ATOMIC_SEQ_CST);
+            uint64_t value;
+            (void) read(wake_fd_, &value, sizeof(value));
+            RunPosted();
+        } else if ( -1 != entry->fd_ ) {
+            entry->callback_(events_[i].events);
+        }
+    }
+
+    for ( auto entry : retired_ ) {
+        delete entry;
+    }
+    retired_.clear();
+    return count;
+}
+
+/**
+ * @brief Dispatch events until #Stop is called
+ */
+void osal::posix::EventLoop::Run ()
+{
+    while ( false == __atomic_load_n(&stop_, __ATOMIC_SEQ_CST) ) {
+        if ( -1 == RunOnce(-1) ) {
+            perror("epoll_wait");
+            break;
+        }
+    }
+    __atomic_store_n(&stop_, false, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Make #Run return, may be called from any thread
+ */
+void osal::posix::EventLoop::Stop ()
+{
+    __atomic_store_n(&stop_, true, __ATOMIC_SEQ_CST);
+    Post([] () {});
+}
+
+/**
+ * @brief Register a descriptor with epoll, edge triggered
+ *
+ * @param a_fd       Descriptor
+ * @param a_events   EPOLL* events
+ * @param a_timer    true if the loop owns the descriptor
+ * @param a_callback Called with the events that fired
+ *
+ * @return false if the descriptor is already registered or epoll refused it
+ */
+bool osal::posix::EventLoop::Add (int a_fd, uint32_t a_events, bool a_timer, const Callback& a_callback)
+{
+    if ( a_fd < 0 || entries_.end() != entries_.find(a_fd) ) {
+        return false;
+    }
+    Entry* entry = new Entry();
+    entry->fd_         = a_fd;
+    entry->timer_      = a_timer;
+    entry->generation_ = 0;
+    entry->callback_   = a_callback;
+
+    struct epoll_event event;
+    event.events   = a_events | EPOLLET;
+    event.data.ptr = entry;
+    if ( 0 != epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, a_fd, &event) ) {
+        delete entry;
+        return false;
+    }
+    entries_[a_fd] = entry;
+    return true;
+}
+
+/**
+ * @brief Unregister a descriptor, its entry is freed after the current batch
+ *
+ * @param a_fd    Descriptor
+ * @param a_timer true to remove a timer, whose descriptor is closed
+ *
+ * @return false if the descriptor was not registered as such
+ */
+bool osal::posix::EventLoop::Remove (int a_fd, bool a_timer)
+{
+    auto it = entries_.find(a_fd);
+    if ( entries_.end() == it || a_timer != it->second->timer_ ) {
+        return false;
+    }
+    Entry* entry = it->second;
+    entries_.erase(it);
+    (void) epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, a_fd, NULL);
+    if ( true == a_timer ) {
+        close(a_fd);
+    }
+    // ... the callback may be the one running now ...
+    entry->fd_ = -1;
+    retired_.push_back(entry);
+    return true;
+}
+
+/**
+ * @brief Run the tasks queued by #Post
+ */
+void osal::posix::EventLoop::RunPosted ()
+{
+    std::vector<Task> tasks;
+    pthread_mutex_lock(&posted_mutex_);
+    tasks.swap(posted_);
+    pthread_mutex_unlock(&posted_mutex_);
+    for ( auto& task : tasks ) {
+        task();
+    }
+}
+
+#endif // __linux__
@@ -0,0 +1,134 @@
+#pragma once
+/**
+ * @file posix_event_loop.h - epoll based event loop, declaration
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper-osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Descriptors are watched edge triggered: a callback is told once per readiness change and
+ * must read, or write, until EAGAIN. Up to #k_max_events_ events are taken per epoll_wait.
+ *
+ * Timers are timerfds and #Post wakes the loop through an eventfd, written only when the
+ * loop was not already woken. Any descriptor can be watched, DatagramSocket and File ones,
+ * or the event fd of a CircularBuffer.
+ *
+ * #Watch, #Unwatch, #AddTimer and #CancelTimer must be called from the loop thread, or
+ * while the loop is not running; other threads #Post them.
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_EVENT_LOOP_H
+#define NRS_OSAL_POSIX_POSIX_EVENT_LOOP_H
+
+#if !defined(__linux__)
+    #error "EventLoop needs epoll"
+#endif
+
+#include "osal/posix/posix_datagram_socket.h"
+#include "osal/posix/posix_file.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace osal
+{
+    namespace posix
+    {
+        class EventLoop
+        {
+
+        public: // Data Type(s)
+
+            typedef std::function<void()>             Task;
+            typedef std::function<void(uint32_t)>     Callback; //!< Called with the EPOLL* events that fired
+            typedef uint64_t                          TimerId;  //!< Generation << 32 | timerfd, stale ids no longer match
+
+            enum : uint32_t {
+                Readable = EPOLLIN,
+                Writable = EPOLLOUT
+            };
+
+        protected: // Data Type(s)
+
+            typedef struct {
+                int      fd_;         //!< -1 once unwatched, later events of the same batch are dropped
+                bool     timer_;      //!< The loop owns, and closes, the descriptor
+                uint32_t generation_; //!< Timers only, tells this timer from an earlier one on the same descriptor
+                Callback callback_;
+            } Entry;
+
+        public: // Static Const
+
+            static const int     k_max_events_    = 64;
+            static const TimerId k_invalid_timer_ = 0;
+
+        protected: // data
+
+            int                                epoll_fd_;
+            int                                wake_fd_;      //!< eventfd written by #Post
+            std::unordered_map<int, Entry*>    entries_;
+            std::vector<Entry*>                retired_;      //!< Unwatched during a batch, freed after it
+            pthread_mutex_t                    posted_mutex_;
+            std::vector<Task>                  posted_;
+            volatile uint32_t                  woken_;        //!< Non zero while #wake_fd_ holds an unread wake-up
+            volatile bool                      stop_;
+            uint32_t                           timer_generation_; //!< Last generation handed to a timer
+            struct epoll_event                 events_[k_max_events_];
+
+        public: // methods
+
+            EventLoop ();
+            virtual ~EventLoop ();
+
+            bool    IsValid     () const;
+
+            bool    Watch       (int a_fd, uint32_t a_events, const Callback& a_callback);
+            bool    Watch       (const DatagramSocket& a_socket, uint32_t a_events, const Callback& a_callback);
+            bool    Watch       (File& a_file, uint32_t a_events, const Callback& a_callback);
+            bool    Unwatch     (int a_fd);
+
+            TimerId AddTimer    (uint64_t a_delay_ms, const Task& a_task, uint64_t a_period_ms = 0);
+            bool    CancelTimer (TimerId a_timer);
+
+            void    Post        (const Task& a_task);
+            int     RunOnce     (int a_timeout_ms = -1);
+            void    Run         ();
+            void    Stop        ();
+
+        protected:
+
+            bool    Add         (int a_fd, uint32_t a_events, bool a_timer, const Callback& a_callback);
+            bool    Remove      (int a_fd, bool a_timer);
+            void    RunPosted   ();
+
+        };
+
+    } // namespace posix
+} // namespace osal
+
+/**
+ * @return false if the epoll or the event file descriptor could not be created
+ */
+inline bool osal::posix::EventLoop::IsValid () const
+{
+    return -1 != epoll_fd_ && -1 != wake_fd_;
+}
+
+#endif // #ifndef NRS_OSAL_POSIX_POSIX_EVENT_LOOP_H
@@ -0,0 +1,371 @@
+#pragma once
+/**
+ * @file posix_fixed_circular_buffer.h Compile time sized, power of two, circular buffers - header only
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * The capacity is a template argument and a power of two: positions run freely and the
+ * offset in the buffer is a mask, no division on the hot path.
+ *
+ * #FixedCircularBuffer keeps the byte API, and the mirrored memory, of #CircularBuffer, with
+ * the split positions of #SPSCCircularBuffer. The capacity must also be a multiple of the page
+ * size, #Init fails otherwise.
+ *
+ * #Ring is an element typed single producer / single consumer ring, with inline storage.
+ *
+ * Both keep a private copy of the other side's position on each side. #FixedCircularBuffer
+ * reloads it when the copy shows fewer bytes than the caller asked for, see #SPSCCircularBuffer.
+ * #Ring slots hold whole elements, so it only reloads when the copy says empty (or full).
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_FIXED_CIRCULAR_BUFFER_H
+#define NRS_OSAL_POSIX_POSIX_FIXED_CIRCULAR_BUFFER_H
+
+#include "osal/posix/posix_circular_buffer.h"
+
+#include <stdint.h>
+#include <string.h> // for memcpy
+
+namespace osal
+{
+    namespace posix
+    {
+
+        template <size_t Capacity> class FixedCircularBuffer : protected CircularBuffer
+        {
+
+            static_assert(0 != Capacity && 0 == ( Capacity & ( Capacity - 1 ) ), "capacity must be a power of two");
+
+        protected: // Const Data
+
+            static const uint64_t k_mask_ = (uint64_t) Capacity - 1;
+
+        protected: // data
+
+            alignas(64) uint64_t write_position_;        //!< Producer owned
+                        uint64_t cached_read_position_;  //!< Producer copy of #read_position_
+            alignas(64) uint64_t read_position_;         //!< Consumer owned
+                        uint64_t cached_write_position_; //!< Consumer copy of #write_position_
+            alignas(64) uint8_t  padding_;
+
+        public: // methods
+
+            FixedCircularBuffer ();
+            virtual ~FixedCircularBuffer();
+
+            bool  Init      (const char* a_data_path, uint8_t a_options = Options::None);
+            void  Clear     ();
+            void  Close     ();
+
+            using CircularBuffer::IsOperational;
+
+            static constexpr size_t Size () { return Capacity; }
+
+        public: // methods
+
+            // Reading (consuming)
+            void*   Tail         (size_t* a_available_bytes, size_t a_min_bytes = 1);
+            void    Consume      (size_t  a_amount);
+
+            // Writing (producing)
+            bool    ProduceBytes (const void* a_source, size_t a_length);
+            void*   Head         (size_t* a_available_bytes, size_t a_min_bytes = 1);
+            void    Produce      (size_t  a_amount);
+
+        protected:
+
+            void  Init    ();
+
+        };
+
+        template <typename T, size_t N> class Ring
+        {
+
+            static_assert(0 != N && 0 == ( N & ( N - 1 ) ), "capacity must be a power of two");
+
+        protected: // Const Data
+
+            static const uint64_t k_mask_ = (uint64_t) N - 1;
+
+        protected: // data
+
+            alignas(64) uint64_t write_position_;        //!< Producer owned
+                        uint64_t cached_read_position_;  //!< Producer copy of #read_position_
+            alignas(64) uint64_t read_position_;         //!< Consumer owned
+                        uint64_t cached_write_position_; //!< Consumer copy of #write_position_
+            alignas(64) T        slots_[N];
+
+        public: // methods
+
+            Ring ();
+
+            static constexpr size_t Size () { return N; }
+
+            // Reading (consuming)
+            T*      Front        ();
+            void    Pop          ();
+            bool    Consume      (T& o_value);
+
+            // Writing (producing)
+            bool    Produce      (const T& a_value);
+
+        };
+
+    } // endof namespace posix
+} // endof namespace osal
+
+/*
+ * FixedCircularBuffer
+ */
+
+template <size_t Capacity>
+inline osal::posix::FixedCircularBuffer<Capacity>::FixedCircularBuffer ()
+{
+    Init();
+}
+
+template <size_t Capacity>
+inline osal::posix::FixedCircularBuffer<Capacity>::~FixedCircularBuffer ()
+{
+    Close();
+}
+
+template <size_t Capacity>
+inline void osal::posix::FixedCircularBuffer<Capacity>::Init ()
+{
+    write_position_        = 0;
+    cached_read_position_  = 0;
+    read_position_         = 0;
+    cached_write_position_ = 0;
+}
+
+/**
+ * @brief Initialise buffer, see CircularBuffer::Init
+ *
+ * @param a_data_path Directory for the temporary backing file, may be NULL when using anonymous memory
+ * @param a_options   Bitmask of CircularBuffer::Options
+ * @return false if the buffer could not be created with exactly Capacity bytes
+ */
+template <size_t Capacity>
+inline bool osal::posix::FixedCircularBuffer<Capacity>::Init (const char* a_data_path, uint8_t a_options)
+{
+    Init();
+    if ( false == CircularBuffer::Init(a_data_path, Capacity, a_options) ) {
+        return false;
+    }
+    // ... rounded up to the page (or huge page) size, the mask would not match ...
+    if ( Capacity != length_ ) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Cleanup buffer
+ *
+ * Releases buffer resources.
+ */
+template <size_t Capacity>
+inline void osal::posix::FixedCircularBuffer<Capacity>::Close ()
+{
+    CircularBuffer::Close();
+    Init();
+}
+
+/**
+ * @brief Clear buffer
+ *
+ * This is safe for use by consumer while producer is accessing
+ * buffer.
+ */
+template <size_t Capacity>
+inline void osal::posix::FixedCircularBuffer<Capacity>::Clear ()
+{
+    size_t count;
+    if ( Tail(&count, Capacity) != NULL ) { // ... asks for more than there can be, forces a reload ...
+        Consume(count);
+    }
+}
+
+/**
+ * Access end of buffer
+ *
+ *  The write position is only reloaded when the cached one shows less than a_min_bytes.
+ *
+ * @param a_available_bytes On output, the number of bytes ready for reading
+ * @param a_min_bytes       Number of bytes the caller needs, fewer may still be returned
+ * @return Pointer to the first bytes ready for reading, or NULL if buffer is empty
+ */
+template <size_t Capacity>
+inline void* osal::posix::FixedCircularBuffer<Capacity>::Tail (size_t* a_available_bytes, size_t a_min_bytes)
+{
+    if ( cached_write_position_ - read_position_ < (uint64_t) a_min_bytes ) {
+        cached_write_position_ = __atomic_load_n(&write_position_, __ATOMIC_ACQUIRE);
+        if ( cached_write_position_ == read_position_ ) {
+            *a_available_bytes = 0;
+            return NULL;
+        }
+    }
+    *a_available_bytes = (size_t) (cached_write_position_ - read_position_);
+    return (void*)((char*) buffer_ + (read_position_ & k_mask_));
+}
+
+/**
+ * Consume bytes in buffer
+ *
+ * @param a_amount Number of bytes to consume
+ */
+template <size_t Capacity>
+inline void osal::posix::FixedCircularBuffer<Capacity>::Consume (size_t a_amount)
+{
+    __atomic_store_n(&read_position_, read_position_ + (uint64_t) a_amount, __ATOMIC_RELEASE);
+}
+
+/**
+ * Access front of buffer
+ *
+ *  The read position is only reloaded when the cached one leaves less than a_min_bytes.
+ *
+ * @param a_available_bytes On output, the number of bytes ready for writing
+ * @param a_min_bytes       Number of bytes the caller needs, fewer may still be returned
+ * @return Pointer to the first bytes ready for writing, or NULL if buffer is full
+ */
+template <size_t Capacity>
+inline void* osal::posix::FixedCircularBuffer<Capacity>::Head (size_t* a_available_bytes, size_t a_min_bytes)
+{
+    if ( (uint64_t) Capacity - (write_position_ - cached_read_position_) < (uint64_t) a_min_bytes ) {
+        cached_read_position_ = __atomic_load_n(&read_position_, __ATOMIC_ACQUIRE);
+        if ( write_position_ - cached_read_position_ == (uint64_t) Capacity ) {
+            *a_available_bytes = 0;
+            return NULL;
+        }
+    }
+    *a_available_bytes = (size_t) ((uint64_t) Capacity - (write_position_ - cached_read_position_));
+    return (void*)((char*) buffer_ + (write_position_ & k_mask_));
+}
+
+/**
+ * Produce bytes in buffer
+ *
+ * @param a_amount Number of bytes to produce
+ */
+template <size_t Capacity>
+inline void osal::posix::FixedCircularBuffer<Capacity>::Produce (size_t a_amount)
+{
+    __atomic_store_n(&write_position_, write_position_ + (uint64_t) a_amount, __ATOMIC_RELEASE);
+}
+
+/**
+ * Helper routine to copy bytes to buffer
+ *
+ * @param a_source Source buffer
+ * @param a_length Number of bytes in source buffer
+ * @return true if bytes copied, false if there was insufficient space
+ */
+template <size_t Capacity>
+inline bool osal::posix::FixedCircularBuffer<Capacity>::ProduceBytes (const void* a_source, size_t a_length)
+{
+    if ( (uint64_t) Capacity - (write_position_ - cached_read_position_) < (uint64_t) a_length ) {
+        cached_read_position_ = __atomic_load_n(&read_position_, __ATOMIC_ACQUIRE);
+        if ( (uint64_t) Capacity - (write_position_ - cached_read_position_) < (uint64_t) a_length ) {
+            return false;
+        }
+    }
+    memcpy((char*) buffer_ + (write_position_ & k_mask_), a_source, a_length);
+    Produce(a_length);
+    return true;
+}
+
+/*
+ * Ring
+ */
+
+template <typename T, size_t N>
+inline osal::posix::Ring<T, N>::Ring ()
+{
+    write_position_        = 0;
+    cached_read_position_  = 0;
+    read_position_         = 0;
+    cached_write_position_ = 0;
+}
+
+/**
+ * @brief Access the oldest element in place
+ *
+ * @return Pointer to the oldest element, or NULL if the ring is empty
+ */
+template <typename T, size_t N>
+inline T* osal::posix::Ring<T, N>::Front ()
+{
+    if ( cached_write_position_ == read_position_ ) {
+        cached_write_position_ = __atomic_load_n(&write_position_, __ATOMIC_ACQUIRE);
+        if ( cached_write_position_ == read_position_ ) {
+            return NULL;
+        }
+    }
+    return &slots_[read_position_ & k_mask_];
+}
+
+/**
+ * @brief Release the element returned by #Front
+ */
+template <typename T, size_t N>
+inline void osal::posix::Ring<T, N>::Pop ()
+{
+    __atomic_store_n(&read_position_, read_position_ + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Move out the oldest element
+ *
+ * @param o_value On output, the oldest element
+ * @return false if the ring is empty
+ */
+template <typename T, size_t N>
+inline bool osal::posix::Ring<T, N>::Consume (T& o_value)
+{
+    T* front = Front();
+    if ( NULL == front ) {
+        return false;
+    }
+    o_value = *front;
+    Pop();
+    return true;
+}
+
+/**
+ * @brief Copy an element into the ring
+ *
+ * @param a_value Element
+ * @return false if the ring is full
+ */
+template <typename T, size_t N>
+inline bool osal::posix::Ring<T, N>::Produce (const T& a_value)
+{
+    if ( write_position_ - cached_read_position_ == (uint64_t) N ) {
+        cached_read_position_ = __atomic_load_n(&read_position_, __ATOMIC_ACQUIRE);
+        if ( write_position_ - cached_read_position_ == (uint64_t) N ) {
+            return false;
+        }
+    }
+    slots_[write_position_ & k_mask_] = a_value;
+    __atomic_store_n(&write_position_, write_position_ + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#endif // NRS_OSAL_POSIX_POSIX_FIXED_CIRCULAR_BUFFER_H
@@ -0,0 +1,94 @@
+#pragma once
+/**
+ * @file posix_futex.h Thin wrapper over the futex system call - header only
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Process private futex on a 32 bit word. Where there is no futex the wait degrades to a
+ * one millisecond sleep and the wake to nothing, callers re-check their condition anyway.
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_FUTEX_H
+#define NRS_OSAL_POSIX_POSIX_FUTEX_H
+
+#include "osal/osal_types.h" // for OSAL_UNUSED_PARAM
+
+#include <stdint.h>
+#include <limits.h> // for INT_MAX
+#include <time.h>   // for struct timespec
+#include <unistd.h> // for syscall, usleep
+
+#if defined(__linux__)
+    #include <sys/syscall.h> // for SYS_futex
+    #include <linux/futex.h> // for FUTEX_WAIT_PRIVATE, FUTEX_WAKE_PRIVATE
+#endif
+
+namespace osal
+{
+    namespace posix
+    {
+        class Futex
+        {
+
+        public: // static methods
+
+            static void Wait (volatile uint32_t* a_word, uint32_t a_expected, const struct timespec* a_timeout = NULL);
+            static void Wake (volatile uint32_t* a_word, int a_count = INT_MAX);
+
+        };
+
+    } // endof namespace posix
+} // endof namespace osal
+
+/**
+ * @brief Sleep while the word holds the expected value
+ *
+ *  May return early ( EAGAIN, EINTR, ETIMEDOUT or spuriously ), the caller re-checks its condition.
+ *
+ * @param a_word     Futex word
+ * @param a_expected Value the caller saw, no sleep if the word changed since
+ * @param a_timeout  Relative timeout, NULL to wait forever
+ */
+inline void osal::posix::Futex::Wait (volatile uint32_t* a_word, uint32_t a_expected, const struct timespec* a_timeout)
+{
+#if defined(__linux__)
+    (void) syscall(SYS_futex, a_word, FUTEX_WAIT_PRIVATE, a_expected, a_timeout, NULL, 0);
+#else
+    OSAL_UNUSED_PARAM(a_timeout);
+    if ( a_expected == __atomic_load_n(a_word, __ATOMIC_ACQUIRE) ) {
+        (void) usleep(1000); // ... not OsalSleepMs, osalite.h would include this header back ...
+    }
+#endif
+}
+
+/**
+ * @brief Wake threads sleeping on the word
+ *
+ * @param a_word  Futex word
+ * @param a_count Maximum number of threads to wake
+ */
+inline void osal::posix::Futex::Wake (volatile uint32_t* a_word, int a_count)
+{
+#if defined(__linux__)
+    (void) syscall(SYS_futex, a_word, FUTEX_WAKE_PRIVATE, a_count, NULL, NULL, 0);
+#else
+    OSAL_UNUSED_PARAM(a_word);
+    OSAL_UNUSED_PARAM(a_count);
+#endif
+}
+
+#endif // NRS_OSAL_POSIX_POSIX_FUTEX_H
@@ -0,0 +1,135 @@
+/**
+ * @file posix_lossy_circular_buffer.cc Overwrite-oldest record circular buffer - implementation
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "osal/posix/posix_lossy_circular_buffer.h"
+
+void osal::posix::LossyCircularBuffer::Init ()
+{
+    write_position_  = 0;
+    oldest_position_ = 0;
+    read_position_   = 0;
+    lost_bytes_      = 0;
+}
+
+/**
+ * @brief Initialise buffer, see CircularBuffer::Init
+ *
+ * @param a_data_path Directory for the temporary backing file, may be NULL when using anonymous memory
+ * @param a_length    Length of buffer
+ * @param a_options   Bitmask of CircularBuffer::Options
+ */
+bool osal::posix::LossyCircularBuffer::Init (const char* a_data_path, size_t a_length, uint8_t a_options)
+{
+    Init();
+    return CircularBuffer::Init(a_data_path, a_length, a_options);
+}
+
+/**
+ * @brief Cleanup buffer
+ *
+ * Releases buffer resources.
+ */
+void osal::posix::LossyCircularBuffer::Close ()
+{
+    CircularBuffer::Close();
+    Init();
+}
+
+/**
+ * @brief Clear buffer
+ *
+ * Skips every committed record, they are not accounted as lost.
+ *
+ * This is safe for use by consumer while producer is accessing
+ * buffer.
+ */
+void osal::posix::LossyCircularBuffer::Clear ()
+{
+    read_position_ = __atomic_load_n(&write_position_, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief Drop the oldest records until the bytes up to the given position fit in the buffer
+ *
+ *  Runs on the producer, that wrote the headers it walks. The new oldest position is made
+ *  visible before any of the dropped bytes is overwritten.
+ *
+ * @param a_end Free running position of the end of the record about to be written
+ */
+void osal::posix::LossyCircularBuffer::Evict (uint64_t a_end)
+{
+    uint64_t oldest = oldest_position_;
+    while ( a_end - oldest > (uint64_t) length_ ) {
+        const RecordHeader* header = (const RecordHeader*) ((const char*) buffer_ + (oldest % (uint64_t) length_));
+        oldest += (uint64_t) RecordSize((size_t) header->length_);
+    }
+    __atomic_store_n(&oldest_position_, oldest, __ATOMIC_RELAXED);
+    // ... store / store barrier, seqlock writer style ...
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Copy out the oldest record still intact
+ *
+ *  Records overwritten before or while they are copied are skipped and accounted in #LostBytes.
+ *
+ * @param o_payload  Destination of the payload
+ * @param a_capacity Capacity of @a o_payload, a longer payload is truncated
+ * @param o_length   On output, the full payload length
+ * @return true if a record was copied, false if there is no record
+ */
+bool osal::posix::LossyCircularBuffer::ConsumeRecord (void* o_payload, size_t a_capacity, size_t* o_length)
+{
+    for ( ;; ) {
+        const uint64_t write_position = __atomic_load_n(&write_position_, __ATOMIC_ACQUIRE);
+        if ( read_position_ == write_position ) {
+            *o_length = 0;
+            return false;
+        }
+
+        uint64_t oldest = __atomic_load_n(&oldest_position_, __ATOMIC_ACQUIRE);
+        if ( read_position_ < oldest ) {
+            lost_bytes_    += oldest - read_position_;
+            read_position_  = oldest;
+            continue;
+        }
+
+        const char*  record   = (const char*) buffer_ + (read_position_ % (uint64_t) length_);
+        RecordHeader header;
+        memcpy(&header, record, sizeof(header));
+        // ... a torn header may carry any length, keep the copy inside the mirrored mapping ...
+        const size_t length = (size_t) MIN(header.length_, (uint64_t) MaxRecordLength());
+        if ( header.sequence_ == read_position_ ) {
+            memcpy(o_payload, record + k_lossy_record_header_size_, MIN(length, a_capacity));
+        }
+
+        // ... seqlock reader: the copy is only good if the producer did not drop the record meanwhile ...
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        oldest = __atomic_load_n(&oldest_position_, __ATOMIC_RELAXED);
+        if ( read_position_ < oldest || header.sequence_ != read_position_ ) {
+            continue;
+        }
+
+        read_position_ += (uint64_t) RecordSize(length);
+        *o_length = length;
+        return true;
+    }
+}
@@ -0,0 +1,193 @@
+#pragma once
+/**
+ * @file posix_lossy_circular_buffer.h Overwrite-oldest record circular buffer - header and inline functions
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Single producer / single consumer record buffer, on the mirrored memory of #CircularBuffer,
+ * for telemetry where the newest data matters most.
+ *
+ * The producer never waits for the consumer: when a record does not fit it drops the oldest
+ * records, publishing the new #oldest_position_ before it overwrites their bytes. Each record
+ * header carries its sequence number, the free running position it was written at.
+ *
+ * The consumer copies records out, since the bytes may be overwritten at any time, and checks
+ * them like a seqlock reader: a header whose sequence number is not the expected position, or
+ * an #oldest_position_ past the record once the copy is done, means the record was overwritten.
+ * The consumer then skips to #oldest_position_ and accounts the skipped bytes in #LostBytes.
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_LOSSY_CIRCULAR_BUFFER_H
+#define NRS_OSAL_POSIX_POSIX_LOSSY_CIRCULAR_BUFFER_H
+
+#include "osal/posix/posix_circular_buffer.h"
+
+#include <stdint.h>
+#include <string.h> // for memcpy
+
+namespace osal
+{
+    namespace posix
+    {
+        class LossyCircularBuffer : protected CircularBuffer
+        {
+        public: // Data Type(s)
+
+            /**
+             * @brief Prefix of each record.
+             */
+            typedef struct {
+                uint64_t sequence_; //!< Free running position of the record
+                uint64_t length_;   //!< Payload length
+            } RecordHeader;
+
+        public: // Const Data
+
+            static const size_t k_lossy_record_header_size_ = sizeof(RecordHeader);
+
+        protected: // data
+
+            alignas(64) uint64_t write_position_;  //!< Producer owned, end of the last committed record
+                        uint64_t oldest_position_; //!< Producer owned, first record not overwritten yet
+            alignas(64) uint64_t read_position_;   //!< Consumer owned
+                        uint64_t lost_bytes_;      //!< Consumer owned, bytes overwritten before they were read
+            alignas(64) uint8_t  padding_;
+
+        public: // methods
+
+            LossyCircularBuffer ();
+            virtual ~LossyCircularBuffer();
+
+            bool  Init      (const char* a_data_path, size_t a_length, uint8_t a_options = Options::None);
+            void  Clear     ();
+            void  Close     ();
+
+            using CircularBuffer::Size;
+            using CircularBuffer::IsOperational;
+
+        public: // methods
+
+            // Writing (producing), never fails for records up to #MaxRecordLength
+            void*   ReserveRecord   (size_t a_length);
+            void    CommitRecord    (size_t a_length);
+            bool    ProduceRecord   (const void* a_payload, size_t a_length);
+
+            // Reading (consuming)
+            bool     ConsumeRecord   (void* o_payload, size_t a_capacity, size_t* o_length);
+            uint64_t LostBytes       () const;
+            size_t   MaxRecordLength () const;
+
+            static size_t RecordSize (size_t a_length);
+
+        protected:
+
+            void  Init    ();
+            void  Evict   (uint64_t a_end);
+
+        };
+
+    } // endof namespace posix
+} // endof namespace osal
+
+inline osal::posix::LossyCircularBuffer::LossyCircularBuffer ()
+{
+    Init();
+}
+
+inline osal::posix::LossyCircularBuffer::~LossyCircularBuffer ()
+{
+    Close();
+}
+
+/**
+ * @brief Bytes used in the buffer by a record, header and padding included
+ *
+ * @param a_length Payload length
+ */
+inline size_t osal::posix::LossyCircularBuffer::RecordSize (size_t a_length)
+{
+    return k_lossy_record_header_size_ + ((a_length + 7) & ~((size_t) 7));
+}
+
+/**
+ * @return Largest payload a single record can carry
+ */
+inline size_t osal::posix::LossyCircularBuffer::MaxRecordLength () const
+{
+    return length_ - k_lossy_record_header_size_;
+}
+
+/**
+ * @return Bytes the consumer had to skip because the producer overwrote them first
+ */
+inline uint64_t osal::posix::LossyCircularBuffer::LostBytes () const
+{
+    return lost_bytes_;
+}
+
+/**
+ * @brief Reserve a contiguous record at the front of the buffer, dropping the oldest records if needed
+ *
+ *  Nothing is visible to the consumer until #CommitRecord.
+ *
+ * @param a_length Maximum payload length
+ * @return Pointer to the payload, or NULL if the record is larger than the buffer
+ */
+inline void* osal::posix::LossyCircularBuffer::ReserveRecord (size_t a_length)
+{
+    if ( a_length > MaxRecordLength() ) {
+        return NULL;
+    }
+    const uint64_t end = write_position_ + (uint64_t) RecordSize(a_length);
+    if ( end - oldest_position_ > (uint64_t) length_ ) {
+        Evict(end);
+    }
+    return (char*) buffer_ + (write_position_ % (uint64_t) length_) + k_lossy_record_header_size_;
+}
+
+/**
+ * @brief Publish the record obtained with #ReserveRecord
+ *
+ * @param a_length Payload length, must not exceed the reserved length
+ */
+inline void osal::posix::LossyCircularBuffer::CommitRecord (size_t a_length)
+{
+    RecordHeader* header = (RecordHeader*) ((char*) buffer_ + (write_position_ % (uint64_t) length_));
+    header->sequence_ = write_position_;
+    header->length_   = (uint64_t) a_length;
+    __atomic_store_n(&write_position_, write_position_ + (uint64_t) RecordSize(a_length), __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Copy a record into the buffer, dropping the oldest records if needed
+ *
+ * @param a_payload Payload
+ * @param a_length  Payload length
+ * @return true if the record was written, false if it is larger than #MaxRecordLength
+ */
+inline bool osal::posix::LossyCircularBuffer::ProduceRecord (const void* a_payload, size_t a_length)
+{
+    void* payload = ReserveRecord(a_length);
+    if ( NULL == payload ) {
+        return false;
+    }
+    memcpy(payload, a_payload, a_length);
+    CommitRecord(a_length);
+    return true;
+}
+
+#endif // NRS_OSAL_POSIX_POSIX_LOSSY_CIRCULAR_BUFFER_H
@@ -0,0 +1,166 @@
+/**
+ * @file posix_mpmc_circular_buffer.cc Lock-free multi-producer / multi-consumer circular buffer - implementation
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "osal/posix/posix_mpmc_circular_buffer.h"
+#include <string.h> // for memcpy
+#include <sched.h>  // for sched_yield
+
+void osal::posix::MPMCCircularBuffer::Init ()
+{
+    reserve_ = 0;
+    commit_  = 0;
+    claim_   = 0;
+    release_ = 0;
+}
+
+/**
+ * @brief Initialise buffer, see CircularBuffer::Init
+ *
+ * @param a_data_path Directory for the temporary backing file, may be NULL when using anonymous memory
+ * @param a_length    Length of buffer
+ * @param a_options   Bitmask of CircularBuffer::Options
+ */
+bool osal::posix::MPMCCircularBuffer::Init (const char* a_data_path, size_t a_length, uint8_t a_options)
+{
+    Init();
+    return CircularBuffer::Init(a_data_path, a_length, a_options);
+}
+
+/**
+ * @brief Cleanup buffer
+ *
+ * Releases buffer resources, no producer or consumer may be active.
+ */
+void osal::posix::MPMCCircularBuffer::Close ()
+{
+    CircularBuffer::Close();
+    Init();
+}
+
+/**
+ * @brief Reserve space for a record
+ *
+ *  The returned memory is contiguous and belongs to the caller until #Commit.
+ *
+ * @param a_length Payload length in bytes
+ * @return Pointer to the payload or NULL if there is not enough free space
+ */
+void* osal::posix::MPMCCircularBuffer::Reserve (size_t a_length)
+{
+    const uint64_t size = RecordSize((uint64_t) a_length);
+
+    uint64_t position = __atomic_load_n(&reserve_, __ATOMIC_RELAXED);
+    do {
+        const uint64_t released = __atomic_load_n(&release_, __ATOMIC_ACQUIRE);
+        if ( position + size - released > (uint64_t) length_ ) {
+            return NULL;
+        }
+    } while ( false == __atomic_compare_exchange_n(&reserve_, &position, position + size, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED) );
+
+    Header* header = HeaderAt(position);
+    header->length_   = (uint64_t) a_length;
+    header->sequence_ = position;
+    return header + 1;
+}
+
+/**
+ * @brief Helper routine to copy bytes to buffer as a single record
+ *
+ * @param a_source Source buffer
+ * @param a_length Number of bytes in source buffer
+ * @return true if bytes copied, false if there was insufficient space
+ */
+bool osal::posix::MPMCCircularBuffer::ProduceBytes (const void* a_source, size_t a_length)
+{
+    void* data = Reserve(a_length);
+    if ( NULL == data ) {
+        return false;
+    }
+    memcpy(data, a_source, a_length);
+    Commit(data);
+    return true;
+}
+
+/**
+ * @brief Claim the oldest committed record
+ *
+ *  The record stays in the buffer, and its memory valid, until #Release.
+ *
+ * @param o_length On output, the payload length in bytes
+ * @return Pointer to the payload or NULL if there is no committed record
+ */
+void* osal::posix::MPMCCircularBuffer::Claim (size_t* o_length)
+{
+    uint64_t position = __atomic_load_n(&claim_, __ATOMIC_RELAXED);
+    Header*  header;
+    do {
+        if ( position == __atomic_load_n(&commit_, __ATOMIC_ACQUIRE) ) {
+            *o_length = 0;
+            return NULL;
+        }
+        // ... if another consumer got here first this may be stale, the CAS will tell ...
+        header = HeaderAt(position);
+    } while ( false == __atomic_compare_exchange_n(&claim_, &position, position + RecordSize(header->length_), true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED) );
+
+    *o_length = (size_t) header->length_;
+    return header + 1;
+}
+
+/**
+ * @brief Helper routine to copy the oldest record out of the buffer
+ *
+ * @param a_destination Destination buffer
+ * @param a_capacity    Size of destination buffer, records that don't fit are truncated
+ * @param o_length      On output, the payload length in bytes
+ * @return true if a record was consumed
+ */
+bool osal::posix::MPMCCircularBuffer::ConsumeBytes (void* a_destination, size_t a_capacity, size_t* o_length)
+{
+    void* data = Claim(o_length);
+    if ( NULL == data ) {
+        return false;
+    }
+    memcpy(a_destination, data, MIN(*o_length, a_capacity));
+    Release(data);
+    return true;
+}
+
+/**
+ * @brief Move a shared sequence number over a range once every range before it was published
+ *
+ * @param a_sequence Sequence number to update
+ * @param a_from     Start of the range, the sequence number must reach this value first
+ * @param a_to       End of the range, the new value of the sequence number
+ */
+void osal::posix::MPMCCircularBuffer::Publish (uint64_t* a_sequence, uint64_t a_from, uint64_t a_to)
+{
+    for ( uint32_t spin = 0 ; __atomic_load_n(a_sequence, __ATOMIC_ACQUIRE) != a_from ; ++spin ) {
+        if ( spin < 64 ) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        } else {
+            // ... the owner of the previous range was preempted ...
+            sched_yield();
+        }
+    }
+    __atomic_store_n(a_sequence, a_to, __ATOMIC_RELEASE);
+}
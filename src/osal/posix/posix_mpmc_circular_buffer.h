@@ -0,0 +1,156 @@
+#pragma once
+/**
+ * @file posix_mpmc_circular_buffer.h Lock-free multi-producer / multi-consumer circular buffer - header and inline functions
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Variable sized records are carved out of the mirrored memory of #CircularBuffer, so every
+ * record is a single contiguous region even when it crosses the end of the buffer.
+ *
+ * Four free running 64 bit sequence numbers drive the protocol, in the spirit of the DPDK rte_ring:
+ *
+ *   @li reserve_ - producers claim space with a CAS;
+ *   @li commit_  - producers publish, in reservation order, what they have written;
+ *   @li claim_   - consumers claim committed records with a CAS;
+ *   @li release_ - consumers return, in claim order, the space of the records they have read.
+ *
+ * No lock is ever taken, the copy in and out of the buffer happens concurrently, only the
+ * publication of a record waits for the publication of the records reserved before it.
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_MPMC_CIRCULAR_BUFFER_H
+#define NRS_OSAL_POSIX_POSIX_MPMC_CIRCULAR_BUFFER_H
+
+#include "osal/posix/posix_circular_buffer.h"
+
+#include <stdint.h>
+#include <stddef.h> // for size_t
+
+namespace osal
+{
+    namespace posix
+    {
+        class MPMCCircularBuffer : protected CircularBuffer
+        {
+        protected: // Data Type(s)
+
+            /**
+             * @brief Record header, the payload follows immediately.
+             */
+            struct Header {
+                uint64_t sequence_; //!< Free running position of the record
+                uint64_t length_;   //!< Payload length in bytes
+            };
+
+        protected: // Const Data
+
+            static const uint64_t k_alignment_ = 8;
+
+        protected: // data
+
+            alignas(64) uint64_t reserve_;
+            alignas(64) uint64_t commit_;
+            alignas(64) uint64_t claim_;
+            alignas(64) uint64_t release_;
+
+        public: // methods
+
+            MPMCCircularBuffer ();
+            virtual ~MPMCCircularBuffer();
+
+            bool  Init      (const char* a_data_path, size_t a_length, uint8_t a_options = Options::None);
+            void  Close     ();
+
+            using CircularBuffer::Size;
+            using CircularBuffer::IsOperational;
+
+        public: // methods
+
+            // Writing (producing), safe from any number of threads
+            void*   Reserve      (size_t a_length);
+            void    Commit       (void* a_data);
+            bool    ProduceBytes (const void* a_source, size_t a_length);
+
+            // Reading (consuming), safe from any number of threads
+            void*   Claim        (size_t* o_length);
+            void    Release      (void* a_data);
+            bool    ConsumeBytes (void* a_destination, size_t a_capacity, size_t* o_length);
+
+        protected:
+
+            void  Init          ();
+
+            static uint64_t RecordSize (uint64_t a_length);
+            static void     Publish    (uint64_t* a_sequence, uint64_t a_from, uint64_t a_to);
+            Header*         HeaderAt   (uint64_t a_position) const;
+
+        };
+
+    } // endof namespace posix
+} // endof namespace osal
+
+inline osal::posix::MPMCCircularBuffer::MPMCCircularBuffer ()
+{
+    Init();
+}
+
+inline osal::posix::MPMCCircularBuffer::~MPMCCircularBuffer ()
+{
+    Close();
+}
+
+/**
+ * @brief Bytes used by a record with the given payload, header and padding included
+ */
+inline uint64_t osal::posix::MPMCCircularBuffer::RecordSize (uint64_t a_length)
+{
+    return sizeof(Header) + ((a_length + k_alignment_ - 1) & ~(k_alignment_ - 1));
+}
+
+/**
+ * @brief Header of the record placed at the given free running position
+ */
+inline osal::posix::MPMCCircularBuffer::Header* osal::posix::MPMCCircularBuffer::HeaderAt (uint64_t a_position) const
+{
+    return (Header*) ((char*) buffer_ + (a_position % (uint64_t) length_));
+}
+
+/**
+ * @brief Publish a record obtained with #Reserve
+ *
+ *  After this call the record is visible to the consumers.
+ *
+ * @param a_data Pointer returned by #Reserve
+ */
+inline void osal::posix::MPMCCircularBuffer::Commit (void* a_data)
+{
+    const Header* header = (const Header*) a_data - 1;
+    Publish(&commit_, header->sequence_, header->sequence_ + RecordSize(header->length_));
+}
+
+/**
+ * @brief Return a record obtained with #Claim to the producers
+ *
+ * @param a_data Pointer returned by #Claim
+ */
+inline void osal::posix::MPMCCircularBuffer::Release (void* a_data)
+{
+    const Header* header = (const Header*) a_data - 1;
+    Publish(&release_, header->sequence_, header->sequence_ + RecordSize(header->length_));
+}
+
+#endif // NRS_OSAL_POSIX_POSIX_MPMC_CIRCULAR_BUFFER_H
@@ -33,11 +33,21 @@ osal::posix::Mutex::Mutex (const char* a_name)
     pthread_mutexattr_t mutex_attr;
 
     rv  = pthread_mutexattr_init(&mutex_attr);
+#if defined(OSAL_MUTEX_ERRORCHECK)
+    rv += pthread_mutexattr_settype(&mutex_attr, PTHREAD_MUTEX_ERRORCHECK);
+#endif
     rv += pthread_mutex_init(&mutex_, &mutex_attr);
     rv += pthread_mutexattr_destroy(&mutex_attr);
 
     name_ = a_name != NULL ? strdup(a_name) : NULL;
 
+#if defined(ENABLE_MUTEX_PROFILE)
+    profile_ = MutexProfiler::Register(name_);
+#else
+    profile_ = NULL;
+#endif
+    hold_start_ = 0;
+
     created_ = rv == 0;
 }
 
@@ -52,7 +62,23 @@ osal::posix::Mutex::~Mutex ()
 
 bool osal::posix::Mutex::Lock ()
 {
-    int rv = pthread_mutex_lock(&mutex_);
+#if defined(ENABLE_MUTEX_PROFILE)
+    int      rv;
+    uint32_t period;
+    if ( NULL != profile_ && true == MutexProfiler::Sample(period) ) {
+        const uint64_t start     = MutexProfiler::Now();
+        const bool     contended = false == TryAcquire();
+        rv = contended ? Acquire() : 0;
+        if ( 0 == rv ) {
+            hold_start_ = MutexProfiler::Now();
+            profile_->Acquired(period, contended, hold_start_ - start, __builtin_return_address(0));
+        }
+    } else {
+        rv = Acquire();
+    }
+#else
+    int rv = Acquire();
+#endif
     DEBUGTRACE_MUTEX("posix_mutex", "%s->Lock()", name_ != NULL ? name_ : "Mutex");
     DEBUGIF("posix_mutex_e") {
         if ( rv != 0 ) {
@@ -65,7 +91,17 @@ bool osal::posix::Mutex::Lock ()
 bool osal::posix::Mutex::Unlock ()
 {
     DEBUGTRACE_MUTEX("posix_mutex", "%s->Unlock()", name_ != NULL ? name_ : "Mutex");
-    int rv = pthread_mutex_unlock(&mutex_);
+#if defined(ENABLE_MUTEX_PROFILE)
+    // ... read while still held, the next owner may start its own sample ...
+    const uint64_t hold_start = hold_start_;
+    hold_start_ = 0;
+    int rv = Release();
+    if ( 0 != hold_start ) {
+        profile_->Released(MutexProfiler::Now() - hold_start);
+    }
+#else
+    int rv = Release();
+#endif
     DEBUGIF("posix_mutex_e") {
         if ( rv != 0 ) {
             DEBUGTRACEX("posix_mutex_e", "%p.Unlock():%d\n", this, rv);
@@ -74,4 +110,42 @@ bool osal::posix::Mutex::Unlock ()
     return rv == 0;
 }
 
+/**
+ * @return 0 on success, a pthread error code otherwise
+ */
+inline int osal::posix::Mutex::Acquire ()
+{
+#if defined(OSAL_MUTEX_PTHREAD)
+    return pthread_mutex_lock(&mutex_);
+#else
+    spin_.Lock();
+    return 0;
+#endif
+}
+
+/**
+ * @return true if the mutex was free and is now held
+ */
+inline bool osal::posix::Mutex::TryAcquire ()
+{
+#if defined(OSAL_MUTEX_PTHREAD)
+    return 0 == pthread_mutex_trylock(&mutex_);
+#else
+    return spin_.TryLock();
+#endif
+}
+
+/**
+ * @return 0 on success, a pthread error code otherwise
+ */
+inline int osal::posix::Mutex::Release ()
+{
+#if defined(OSAL_MUTEX_PTHREAD)
+    return pthread_mutex_unlock(&mutex_);
+#else
+    spin_.Unlock();
+    return 0;
+#endif
+}
+
 // endof $Id: $
@@ -25,6 +25,9 @@
 #ifndef NRS_OSAL_POSIX_POSIX_MUTEX_H
 #define NRS_OSAL_POSIX_POSIX_MUTEX_H
 
+#include "osal/posix/posix_spin_mutex.h"
+#include "osal/posix/posix_mutex_profiler.h"
+
 #include <pthread.h>
 
 namespace osal {
@@ -37,8 +40,11 @@ namespace osal {
         protected: // data
 
             bool            created_;
-            pthread_mutex_t mutex_;
+            pthread_mutex_t mutex_;  //!< Used by OSAL_MUTEX_PTHREAD builds
+            SpinMutex       spin_;   //!< Used otherwise
             char*           name_;
+            MutexProfile*   profile_;    //!< Only set with ENABLE_MUTEX_PROFILE
+            uint64_t        hold_start_; //!< Acquisition time of a sampled hold, 0 otherwise
 
         public: // constructor(s) / destructor
 
@@ -50,6 +56,12 @@ namespace osal {
             bool Lock ();
             bool Unlock ();
 
+        protected:
+
+            int  Acquire    ();
+            bool TryAcquire ();
+            int  Release    ();
+
         };
 
     }
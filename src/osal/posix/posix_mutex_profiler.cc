@@ -0,0 +1,329 @@
+/**
+ * @file posix_mutex_profiler.cc Sampled contention profile of the named mutexes, implementation
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "osal/posix/posix_mutex_profiler.h"
+
+#include <execinfo.h> // backtrace_symbols
+#include <inttypes.h> // PRIu64
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+uint32_t osal::posix::MutexProfiler::period_ = osal::posix::MutexProfiler::k_default_period_;
+
+static pthread_mutex_t                                    s_registry_mutex_ = PTHREAD_MUTEX_INITIALIZER;
+static std::map<std::string, osal::posix::MutexProfile*>* s_registry_       = NULL; // ... never freed, mutexes may outlive static destructors ...
+
+#ifdef __APPLE__
+#pragma mark - MutexProfile
+#endif
+
+/**
+ * @param a_name Name shared by the profiled mutexes
+ */
+osal::posix::MutexProfile::MutexProfile (const char* a_name)
+{
+    name_ = strdup(a_name);
+    Reset();
+}
+
+osal::posix::MutexProfile::~MutexProfile ()
+{
+    free(name_);
+}
+
+/**
+ * @brief Record a sampled acquisition
+ *
+ * @param a_period    Sampling period, the number of acquisitions this sample stands for
+ * @param a_contended true if the mutex was held when Lock was called
+ * @param a_wait_ns   Time from the Lock call to the acquisition
+ * @param a_site      Return address of the Lock call
+ */
+void osal::posix::MutexProfile::Acquired (uint32_t a_period, bool a_contended, uint64_t a_wait_ns, void* a_site)
+{
+    Add(acquisitions_, a_period);
+    Add(sampled_, 1);
+    if ( false == a_contended ) {
+        return;
+    }
+    Add(contended_, 1);
+    Add(wait_ns_, a_wait_ns);
+    Add(wait_histogram_[Bucket(a_wait_ns)], 1);
+
+    // ... open addressing, a slot is claimed once and never given back ...
+    const uintptr_t hash = ( (uintptr_t) a_site >> 4 ) * 2654435761U;
+    for ( int i = 0; i < k_sites_; ++i ) {
+        Site& site = sites_[( hash + (uintptr_t) i ) % k_sites_];
+        void* address = __atomic_load_n(&site.address_, __ATOMIC_ACQUIRE);
+        if ( NULL == address ) {
+            if ( false == __atomic_compare_exchange_n(&site.address_, &address, a_site, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+                && a_site != address ) {
+                continue;
+            }
+        } else if ( a_site != address ) {
+            continue;
+        }
+        Add(site.count_, 1);
+        Add(site.wait_ns_, a_wait_ns);
+        return;
+    }
+    Add(other_sites_, 1);
+}
+
+/**
+ * @brief Record the hold time of a sampled acquisition
+ *
+ * @param a_hold_ns Time from the acquisition to the release
+ */
+void osal::posix::MutexProfile::Released (uint64_t a_hold_ns)
+{
+    Add(hold_ns_, a_hold_ns);
+    Add(hold_histogram_[Bucket(a_hold_ns)], 1);
+}
+
+/**
+ * @brief Zero the counters, the call sites already claimed keep their slots
+ */
+void osal::posix::MutexProfile::Reset ()
+{
+    acquisitions_ = 0;
+    sampled_      = 0;
+    contended_    = 0;
+    wait_ns_      = 0;
+    hold_ns_      = 0;
+    other_sites_  = 0;
+    for ( int i = 0; i < k_buckets_; ++i ) {
+        wait_histogram_[i] = 0;
+        hold_histogram_[i] = 0;
+    }
+    for ( int i = 0; i < k_sites_; ++i ) {
+        sites_[i].count_   = 0;
+        sites_[i].wait_ns_ = 0;
+    }
+}
+
+/**
+ * @brief Write the counters, the wait and hold percentiles and the top waiting call sites
+ *
+ * @param a_file Where to write
+ */
+void osal::posix::MutexProfile::Dump (FILE* a_file) const
+{
+    const uint64_t sampled   = __atomic_load_n(&sampled_  , __ATOMIC_RELAXED);
+    const uint64_t contended = __atomic_load_n(&contended_, __ATOMIC_RELAXED);
+
+    fprintf(a_file, "%s: ~%" PRIu64 " acquisitions, %" PRIu64 " sampled, %" PRIu64 " contended (%.1f%%)\n",
+            name_, __atomic_load_n(&acquisitions_, __ATOMIC_RELAXED), sampled, contended,
+            0 != sampled ? 100.0 * (double) contended / (double) sampled : 0.0);
+    if ( 0 == sampled ) {
+        return;
+    }
+    fprintf(a_file, "    hold: %" PRIu64 " us total, p50 < %" PRIu64 " ns, p99 < %" PRIu64 " ns, max < %" PRIu64 " ns\n",
+            __atomic_load_n(&hold_ns_, __ATOMIC_RELAXED) / 1000,
+            Percentile(hold_histogram_, 0.50), Percentile(hold_histogram_, 0.99), Percentile(hold_histogram_, 1.0));
+
+    if ( 0 == contended ) {
+        return;
+    }
+    fprintf(a_file, "    wait: %" PRIu64 " us total, p50 < %" PRIu64 " ns, p99 < %" PRIu64 " ns, max < %" PRIu64 " ns\n",
+            __atomic_load_n(&wait_ns_, __ATOMIC_RELAXED) / 1000,
+            Percentile(wait_histogram_, 0.50), Percentile(wait_histogram_, 0.99), Percentile(wait_histogram_, 1.0));
+
+    // ... call sites, most waited first, sorted on a copy: other threads keep counting ...
+    std::vector<Site> sites;
+    for ( int i = 0; i < k_sites_; ++i ) {
+        Site site;
+        site.address_ = __atomic_load_n(&sites_[i].address_, __ATOMIC_ACQUIRE);
+        site.count_   = __atomic_load_n(&sites_[i].count_  , __ATOMIC_RELAXED);
+        site.wait_ns_ = __atomic_load_n(&sites_[i].wait_ns_, __ATOMIC_RELAXED);
+        if ( NULL != site.address_ && 0 != site.count_ ) {
+            sites.push_back(site);
+        }
+    }
+    if ( 0 == sites.size() ) {
+        return;
+    }
+    std::sort(sites.begin(), sites.end(), [] (const Site& a_lhs, const Site& a_rhs) {
+        return a_lhs.wait_ns_ > a_rhs.wait_ns_;
+    });
+    const size_t top = std::min(sites.size(), (size_t) 10);
+    void* addresses[10];
+    for ( size_t i = 0; i < top; ++i ) {
+        addresses[i] = sites[i].address_;
+    }
+    char** symbols = backtrace_symbols(addresses, (int) top);
+    fprintf(a_file, "    top waiting call sites:\n");
+    for ( size_t i = 0; i < top; ++i ) {
+        fprintf(a_file, "        %8" PRIu64 " waits %10" PRIu64 " us  %s\n",
+                sites[i].count_, sites[i].wait_ns_ / 1000,
+                NULL != symbols ? symbols[i] : "?");
+    }
+    free(symbols);
+    const uint64_t others = __atomic_load_n(&other_sites_, __ATOMIC_RELAXED);
+    if ( 0 != others ) {
+        fprintf(a_file, "        %8" PRIu64 " waits from untracked call sites\n", others);
+    }
+}
+
+/**
+ * @brief Increment shared by every sampling thread
+ */
+void osal::posix::MutexProfile::Add (uint64_t& a_counter, uint64_t a_amount)
+{
+    __atomic_add_fetch(&a_counter, a_amount, __ATOMIC_RELAXED);
+}
+
+/**
+ * @return Histogram bucket of a time in nanoseconds
+ */
+int osal::posix::MutexProfile::Bucket (uint64_t a_ns)
+{
+    if ( 0 == a_ns ) {
+        return 0;
+    }
+    const int bucket = 64 - __builtin_clzll(a_ns);
+    return bucket < k_buckets_ ? bucket : k_buckets_ - 1;
+}
+
+/**
+ * @param a_histogram One of the histograms
+ * @param a_fraction  0.5 for the median and so on
+ *
+ * @return Upper bound of the bucket holding the percentile, in nanoseconds
+ */
+uint64_t osal::posix::MutexProfile::Percentile (const uint64_t* a_histogram, double a_fraction)
+{
+    uint64_t total = 0;
+    for ( int i = 0; i < k_buckets_; ++i ) {
+        total += __atomic_load_n(&a_histogram[i], __ATOMIC_RELAXED);
+    }
+    const uint64_t rank = (uint64_t) ( a_fraction * (double) total + 0.5 );
+    uint64_t       seen = 0;
+    int            last = 0;
+    for ( int i = 0; i < k_buckets_; ++i ) {
+        const uint64_t count = __atomic_load_n(&a_histogram[i], __ATOMIC_RELAXED);
+        if ( 0 == count ) {
+            continue;
+        }
+        last  = i;
+        seen += count;
+        if ( seen >= rank ) {
+            break;
+        }
+    }
+    return 1ULL << last;
+}
+
+#ifdef __APPLE__
+#pragma mark - MutexProfiler
+#endif
+
+/**
+ * @brief Find or create the profile of a name
+ *
+ * @param a_name Mutex name, NULL for the unnamed ones
+ *
+ * @return The profile, never freed
+ */
+osal::posix::MutexProfile* osal::posix::MutexProfiler::Register (const char* a_name)
+{
+    const std::string name = NULL != a_name ? a_name : "Mutex";
+
+    pthread_mutex_lock(&s_registry_mutex_);
+    if ( NULL == s_registry_ ) {
+        s_registry_ = new std::map<std::string, MutexProfile*>();
+    }
+    MutexProfile* profile;
+    const auto it = s_registry_->find(name);
+    if ( s_registry_->end() != it ) {
+        profile = it->second;
+    } else {
+        profile = new MutexProfile(name.c_str());
+        (*s_registry_)[name] = profile;
+    }
+    pthread_mutex_unlock(&s_registry_mutex_);
+    return profile;
+}
+
+/**
+ * @brief Set how often acquisitions are timed, may be called at any time
+ *
+ * @param a_period Time one in a_period acquisitions of each thread, 1 for all of them, 0 for none
+ */
+void osal::posix::MutexProfiler::SetSampling (uint32_t a_period)
+{
+    __atomic_store_n(&period_, a_period, __ATOMIC_RELAXED);
+}
+
+/**
+ * @return The sampling period, 0 when profiling is paused
+ */
+uint32_t osal::posix::MutexProfiler::Sampling ()
+{
+    return __atomic_load_n(&period_, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Write every profile, the most contended first
+ *
+ * @param a_file Where to write
+ */
+void osal::posix::MutexProfiler::Dump (FILE* a_file)
+{
+    pthread_mutex_lock(&s_registry_mutex_);
+    // ... sorted on a snapshot of the wait times, other threads keep counting ...
+    std::vector<std::pair<uint64_t, const MutexProfile*>> profiles;
+    if ( NULL != s_registry_ ) {
+        for ( auto it : *s_registry_ ) {
+            profiles.push_back(std::make_pair(__atomic_load_n(&it.second->wait_ns_, __ATOMIC_RELAXED), it.second));
+        }
+    }
+    std::sort(profiles.begin(), profiles.end(), [] (const std::pair<uint64_t, const MutexProfile*>& a_lhs, const std::pair<uint64_t, const MutexProfile*>& a_rhs) {
+        return a_lhs.first > a_rhs.first;
+    });
+    fprintf(a_file, "mutex profile, sampling 1 in %u:\n", Sampling());
+    for ( auto profile : profiles ) {
+        profile.second->Dump(a_file);
+    }
+    fflush(a_file);
+    pthread_mutex_unlock(&s_registry_mutex_);
+}
+
+/**
+ * @brief Zero every profile, racy against acquisitions being recorded
+ */
+void osal::posix::MutexProfiler::Reset ()
+{
+    pthread_mutex_lock(&s_registry_mutex_);
+    if ( NULL != s_registry_ ) {
+        for ( auto it : *s_registry_ ) {
+            it.second->Reset();
+        }
+    }
+    pthread_mutex_unlock(&s_registry_mutex_);
+}
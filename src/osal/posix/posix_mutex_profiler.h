@@ -0,0 +1,168 @@
+#pragma once
+/**
+ * @file posix_mutex_profiler.h Sampled contention profile of the named mutexes, declaration
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Mutex only profiles when the library is built with ENABLE_MUTEX_PROFILE, otherwise it never
+ * calls in here and the lock paths are unchanged.
+ *
+ * When enabled, one acquisition in #MutexProfiler::SetSampling, per thread, is timed: a try lock
+ * tells whether it was contended, the wait and the hold times go to log2 histograms and the
+ * caller of a contended Lock to a small table of call sites. Mutexes with the same name share one
+ * profile, which lives until the process exits.
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_MUTEX_PROFILER_H
+#define NRS_OSAL_POSIX_POSIX_MUTEX_PROFILER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+namespace osal
+{
+    namespace posix
+    {
+
+        /**
+         * @brief Counters of all the mutexes sharing one name, updated with relaxed atomics.
+         */
+        class MutexProfile
+        {
+
+            friend class MutexProfiler;
+
+        public: // Static Const
+
+            static const int k_buckets_ = 32; //!< Bucket i counts times below 2^i ns, the last one everything above
+            static const int k_sites_   = 32; //!< Call sites kept, contended acquisitions from others are counted apart
+
+        protected: // Data Type(s)
+
+            typedef struct {
+                void*    address_; //!< Return address of the Lock call, set once
+                uint64_t count_;
+                uint64_t wait_ns_;
+            } Site;
+
+        protected: // data
+
+            char*    name_;
+            uint64_t acquisitions_; //!< Estimate, every sample counts for the sampling period
+            uint64_t sampled_;
+            uint64_t contended_;
+            uint64_t wait_ns_;
+            uint64_t hold_ns_;
+            uint64_t wait_histogram_[k_buckets_]; //!< Contended acquisitions only
+            uint64_t hold_histogram_[k_buckets_];
+            Site     sites_[k_sites_];
+            uint64_t other_sites_;
+
+        public: // methods
+
+            void  Acquired (uint32_t a_period, bool a_contended, uint64_t a_wait_ns, void* a_site);
+            void  Released (uint64_t a_hold_ns);
+
+        protected:
+
+            MutexProfile (const char* a_name);
+            virtual ~MutexProfile ();
+
+            void  Reset ();
+            void  Dump  (FILE* a_file) const;
+
+            static void     Add        (uint64_t& a_counter, uint64_t a_amount);
+            static int      Bucket     (uint64_t a_ns);
+            static uint64_t Percentile (const uint64_t* a_histogram, double a_fraction);
+
+        };
+
+        /**
+         * @brief Registry of the profiles and sampling control.
+         */
+        class MutexProfiler
+        {
+
+        public: // Static Const
+
+            static const uint32_t k_default_period_ = 100; //!< About 1% of the acquisitions
+
+        protected: // Static Data
+
+            static uint32_t period_;
+
+        public: // methods
+
+            static MutexProfile* Register    (const char* a_name);
+            static void          SetSampling (uint32_t a_period);
+            static uint32_t      Sampling    ();
+            static void          Dump        (FILE* a_file);
+            static void          Reset       ();
+
+            static bool          Sample      (uint32_t& o_period);
+            static uint64_t      Now         ();
+
+        };
+
+    } // endof namespace posix
+} // endof namespace osal
+
+/**
+ * @brief Tell whether the calling thread should time this acquisition
+ *
+ *  The gap to the next sample is drawn between 1 and twice the period, a fixed gap would lock
+ *  onto threads that take several mutexes in turn and only ever sample one of them.
+ *
+ * @param o_period On output, the sampling period the sample stands for
+ *
+ * @return true once every period acquisitions of the calling thread, on average
+ */
+inline bool osal::posix::MutexProfiler::Sample (uint32_t& o_period)
+{
+    static __thread uint32_t countdown = 0;
+    static __thread uint32_t random    = 0;
+    o_period = __atomic_load_n(&period_, __ATOMIC_RELAXED);
+    if ( 0 == o_period ) {
+        return false;
+    }
+    if ( countdown > 1 && countdown < 2 * o_period ) {
+        --countdown;
+        return false;
+    }
+    // ... xorshift, seeded from the thread's own storage ...
+    if ( 0 == random ) {
+        random = (uint32_t) (uintptr_t) &countdown | 1;
+    }
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    countdown = 1 + random % ( 2 * o_period - 1 );
+    return true;
+}
+
+/**
+ * @return Monotonic time, in nanoseconds
+ */
+inline uint64_t osal::posix::MutexProfiler::Now ()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+#endif // NRS_OSAL_POSIX_POSIX_MUTEX_PROFILER_H
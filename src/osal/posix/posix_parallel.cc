@@ -0,0 +1,118 @@
+/**
+ * @file posix_parallel.cc - Parallel for and reduce over a ThreadPool, implementation
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper-osal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "osal/posix/posix_parallel.h"
+#include "osal/posix/posix_futex.h"
+
+#include <memory>
+
+/**
+ * @brief Run a body over a range in chunks, spread over the pool threads and the caller
+ *
+ * @param a_pool  Pool that lends the helper threads
+ * @param a_begin First index
+ * @param a_end   One past the last index
+ * @param a_grain Smallest number of indices handed out at once, 0 is taken as 1
+ * @param a_body  Called as a_body(chunk_begin, chunk_end), from several threads at once
+ */
+void osal::posix::Parallel::Run (ThreadPool& a_pool, size_t a_begin, size_t a_end, size_t a_grain, const Body& a_body)
+{
+    if ( a_end <= a_begin ) {
+        return;
+    }
+    const size_t grain   = 0 != a_grain ? a_grain : 1;
+    const size_t count   = a_end - a_begin;
+    const size_t chunks  = ( count + grain - 1 ) / grain;
+    const size_t helpers = chunks - 1 < a_pool.Size() ? chunks - 1 : a_pool.Size();
+    if ( 0 == helpers ) {
+        a_body(a_begin, a_end);
+        return;
+    }
+
+    // ... shared with the helpers, a helper may only start after this call returned ...
+    std::shared_ptr<Context> context(new Context(), [] (Context* a_context) {
+        pthread_mutex_destroy(&a_context->mutex_);
+        delete a_context;
+    });
+    context->next_         = a_begin;
+    context->end_          = a_end;
+    context->grain_        = grain;
+    context->participants_ = helpers + 1;
+    context->pending_      = count;
+    context->done_         = 0;
+    context->body_         = a_body;
+    pthread_mutex_init(&context->mutex_, NULL);
+
+    for ( size_t i = 0; i < helpers; ++i ) {
+        a_pool.Submit([context] () {
+            Participate(*context);
+        });
+    }
+    Participate(*context);
+
+    while ( 0 == __atomic_load_n(&context->done_, __ATOMIC_SEQ_CST) ) {
+        Futex::Wait(&context->done_, 0);
+    }
+    if ( context->error_ ) {
+        std::rethrow_exception(context->error_);
+    }
+}
+
+/**
+ * @brief Claim and run chunks until the range runs out
+ *
+ * @param a_context State of the call
+ */
+void osal::posix::Parallel::Participate (Context& a_context)
+{
+    for ( ;; ) {
+        size_t begin = __atomic_load_n(&a_context.next_, __ATOMIC_RELAXED);
+        size_t chunk;
+        do {
+            if ( begin >= a_context.end_ ) {
+                return;
+            }
+            const size_t remaining = a_context.end_ - begin;
+            chunk = remaining / ( 2 * a_context.participants_ );
+            if ( chunk < a_context.grain_ ) {
+                chunk = a_context.grain_;
+            }
+            if ( chunk > remaining ) {
+                chunk = remaining;
+            }
+        } while ( false == __atomic_compare_exchange_n(&a_context.next_, &begin, begin + chunk, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED) );
+
+        try {
+            a_context.body_(begin, begin + chunk);
+        } catch (...) {
+            pthread_mutex_lock(&a_context.mutex_);
+            if ( ! a_context.error_ ) {
+                a_context.error_ = std::current_exception();
+            }
+            pthread_mutex_unlock(&a_context.mutex_);
+        }
+
+        if ( 0 == __atomic_sub_fetch(&a_context.pending_, chunk, __ATOMIC_SEQ_CST) ) {
+            __atomic_store_n(&a_context.done_, 1, __ATOMIC_SEQ_CST);
+            Futex::Wake(&a_context.done_);
+        }
+    }
+}
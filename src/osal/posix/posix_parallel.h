@@ -0,0 +1,148 @@
+#pragma once
+/**
+ * @file posix_parallel.h - Parallel for and reduce over a ThreadPool, declaration
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper-osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * The calling thread and up to one helper per pool thread claim chunks of the range from a
+ * shared cursor. Chunks start large, half the remaining range split across the participants,
+ * and shrink down to the grain as the range runs out, so a slow participant only holds a small
+ * tail. The caller always takes part, the call completes even when every pool thread is busy.
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_PARALLEL_H
+#define NRS_OSAL_POSIX_POSIX_PARALLEL_H
+
+#include "osal/posix/posix_thread_pool.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h> // for size_t
+
+#include <exception>
+#include <functional>
+
+namespace osal
+{
+    namespace posix
+    {
+        class Parallel
+        {
+
+        public: // Data Type(s)
+
+            typedef std::function<void(size_t, size_t)> Body;
+
+        protected: // Data Type(s)
+
+            /**
+             * @brief State shared by the participants of one call, helpers that start after the
+             *        range ran out only read the cursor.
+             */
+            typedef struct {
+                volatile size_t    next_;         //!< First index not yet claimed
+                size_t             end_;
+                size_t             grain_;        //!< Smallest chunk
+                size_t             participants_;
+                volatile size_t    pending_;      //!< Indices not yet done
+                volatile uint32_t  done_;         //!< Futex word, set once #pending_ drops to zero
+                pthread_mutex_t    mutex_;        //!< Guards #error_
+                std::exception_ptr error_;        //!< First exception thrown by the body
+                Body               body_;
+            } Context;
+
+        public: // static methods
+
+            static void Run (ThreadPool& a_pool, size_t a_begin, size_t a_end, size_t a_grain, const Body& a_body);
+
+            template <class Function>
+            static void For (ThreadPool& a_pool, size_t a_begin, size_t a_end, size_t a_grain, const Function& a_function);
+
+            template <typename T, class Function, class Combine>
+            static T Reduce (ThreadPool& a_pool, size_t a_begin, size_t a_end, size_t a_grain,
+                             const T& a_identity, const Function& a_function, const Combine& a_combine);
+
+        protected: // static methods
+
+            static void Participate (Context& a_context);
+
+        };
+
+    } // namespace posix
+} // namespace osal
+
+/**
+ * @brief Call a function for every index of a range, spread over the pool threads
+ *
+ *  Returns once every index was processed. An exception thrown by the function is re-thrown
+ *  here, the remaining chunks still run.
+ *
+ * @param a_pool     Pool that lends the helper threads
+ * @param a_begin    First index
+ * @param a_end      One past the last index
+ * @param a_grain    Smallest number of indices handed out at once
+ * @param a_function Called as a_function(index)
+ */
+template <class Function>
+inline void osal::posix::Parallel::For (ThreadPool& a_pool, size_t a_begin, size_t a_end, size_t a_grain, const Function& a_function)
+{
+    Run(a_pool, a_begin, a_end, a_grain, [&a_function] (size_t a_chunk_begin, size_t a_chunk_end) {
+        for ( size_t index = a_chunk_begin; index < a_chunk_end; ++index ) {
+            a_function(index);
+        }
+    });
+}
+
+/**
+ * @brief Reduce a range spread over the pool threads
+ *
+ *  The chunk results are combined in completion order, a_combine must be associative and
+ *  commutative.
+ *
+ * @param a_pool     Pool that lends the helper threads
+ * @param a_begin    First index
+ * @param a_end      One past the last index
+ * @param a_grain    Smallest number of indices handed out at once
+ * @param a_identity Result of an empty range
+ * @param a_function Called as a_function(chunk_begin, chunk_end), returns the result of the chunk
+ * @param a_combine  Called as a_combine(result, result), returns the combined result
+ *
+ * @return The combined result of every chunk
+ */
+template <typename T, class Function, class Combine>
+inline T osal::posix::Parallel::Reduce (ThreadPool& a_pool, size_t a_begin, size_t a_end, size_t a_grain,
+                                        const T& a_identity, const Function& a_function, const Combine& a_combine)
+{
+    T               result = a_identity;
+    pthread_mutex_t mutex;
+    pthread_mutex_init(&mutex, NULL);
+    try {
+        Run(a_pool, a_begin, a_end, a_grain, [&] (size_t a_chunk_begin, size_t a_chunk_end) {
+            T partial = a_function(a_chunk_begin, a_chunk_end);
+            pthread_mutex_lock(&mutex);
+            result = a_combine(result, partial);
+            pthread_mutex_unlock(&mutex);
+        });
+    } catch (...) {
+        pthread_mutex_destroy(&mutex);
+        throw;
+    }
+    pthread_mutex_destroy(&mutex);
+    return result;
+}
+
+#endif // #ifndef NRS_OSAL_POSIX_POSIX_PARALLEL_H
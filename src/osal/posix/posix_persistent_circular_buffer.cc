@@ -0,0 +1,299 @@
+/**
+ * @file posix_persistent_circular_buffer.cc Crash recoverable file backed circular buffer - implementation
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "osal/posix/posix_persistent_circular_buffer.h"
+#include "osal/debug_trace.h"
+#include <string.h>   // for memcpy
+#include <unistd.h>   // for close, ftruncate, fsync
+#include <fcntl.h>    // for open
+#include <stdio.h>    // for perror
+#include <time.h>     // for clock_gettime
+#include <sys/stat.h> // for fstat
+
+#ifdef __ANDROID__
+#undef perror
+#define perror(V) DEBUGTRACE("PersistentCircularBuffer", V)
+#endif
+
+void osal::posix::PersistentCircularBuffer::Init ()
+{
+    header_                 = NULL;
+    buffer_                 = NULL;
+    header_length_          = 0;
+    length_                 = 0;
+    fd_                     = -1;
+    policy_.bytes_          = 0;
+    policy_.interval_ms_    = 0;
+    write_position_         = 0;
+    durable_write_position_ = 0;
+    durable_read_position_  = 0;
+    pending_since_ms_       = -1;
+    read_position_          = 0;
+}
+
+/**
+ * @brief Open the spool file, resuming from its durable state when it was already initialized
+ *
+ * @param a_data_path Spool file, created when missing and never unlinked
+ * @param a_length    Length of a new buffer, rounded up to a multiple of the page size; an existing
+ *                    file keeps the length it was created with
+ * @param a_policy    When #Produce makes the pending bytes durable
+ * @return true on success, false on I/O error or if the file is not a valid spool
+ */
+bool osal::posix::PersistentCircularBuffer::Init (const char* a_data_path, size_t a_length, const SyncPolicy& a_policy)
+{
+    const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    struct stat  st;
+
+    Close();
+
+    const int fd = open(a_data_path, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if ( fd < 0 ) {
+        perror("open");
+        return false;
+    }
+    if ( 0 != fstat(fd, &st) ) {
+        perror("fstat");
+        close(fd);
+        return false;
+    }
+
+    // ... an existing spool? a file whose header was never completed (magic still 0) is recreated ...
+    if ( st.st_size > (off_t) page_size ) {
+        Header* header = (Header*) mmap(NULL, page_size, PROT_READ, MAP_SHARED, fd, 0);
+        if ( header == MAP_FAILED ) {
+            perror("map header");
+            close(fd);
+            return false;
+        }
+        const Header saved  = *header;
+        munmap(header, page_size);
+
+        if ( 0 != saved.magic_ ) {
+            const bool valid = saved.magic_ == k_magic_
+                                && saved.version_ == k_version_
+                                && 0 != saved.length_ && 0 == saved.length_ % page_size
+                                && (off_t) (saved.length_ + page_size) == st.st_size
+                                && saved.read_position_ <= saved.write_position_
+                                && saved.write_position_ - saved.read_position_ <= saved.length_;
+            if ( false == valid || false == Map(fd, (size_t) saved.length_) ) {
+                close(fd);
+                return false;
+            }
+            policy_                 = a_policy;
+            write_position_         = saved.write_position_;
+            durable_write_position_ = saved.write_position_;
+            durable_read_position_  = saved.read_position_;
+            read_position_          = saved.read_position_;
+            return true;
+        }
+    }
+
+    const size_t length = ((a_length + page_size - 1) / page_size) * page_size;
+    if ( 0 == length || 0 != ftruncate(fd, (off_t) (page_size + length)) ) {
+        perror("ftruncate");
+        close(fd);
+        return false;
+    }
+    if ( false == Map(fd, length) ) {
+        close(fd);
+        return false;
+    }
+    policy_                  = a_policy;
+    header_->version_        = k_version_;
+    header_->length_         = (uint64_t) length;
+    header_->write_position_ = 0;
+    header_->read_position_  = 0;
+    if ( 0 != msync(header_, header_length_, MS_SYNC) ) {
+        perror("msync");
+    }
+    // ... the magic is written, and made durable, last ...
+    header_->magic_ = k_magic_;
+    if ( 0 != msync(header_, header_length_, MS_SYNC) || 0 != fsync(fd) ) {
+        perror("fsync");
+        Close();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Map the header page, and the data twice back to back
+ */
+bool osal::posix::PersistentCircularBuffer::Map (int a_fd, size_t a_length)
+{
+    const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+
+    uint8_t* base = (uint8_t*) mmap(NULL, page_size + a_length * 2, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if ( base == MAP_FAILED ) {
+        perror("map anon");
+        return false;
+    }
+    if ( MAP_FAILED == mmap(base, page_size, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_SHARED, a_fd, 0)
+        || MAP_FAILED == mmap(base + page_size, a_length, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_SHARED, a_fd, (off_t) page_size)
+        || MAP_FAILED == mmap(base + page_size + a_length, a_length, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_SHARED, a_fd, (off_t) page_size) ) {
+        perror("map file");
+        munmap(base, page_size + a_length * 2);
+        return false;
+    }
+    header_        = (Header*) base;
+    buffer_        = base + page_size;
+    header_length_ = page_size;
+    length_        = a_length;
+    fd_            = a_fd;
+    return true;
+}
+
+/**
+ * @brief Make everything durable and close the file, the file itself is kept
+ */
+void osal::posix::PersistentCircularBuffer::Close ()
+{
+    if ( NULL != header_ ) {
+        Sync();
+        munmap(header_, header_length_ + length_ * 2);
+    }
+    if ( -1 != fd_ ) {
+        close(fd_);
+    }
+    Init();
+}
+
+/**
+ * @brief Make the produced bytes and both positions durable, producer thread only
+ *
+ *  The data is flushed before the header that covers it, a crash in between leaves the previous
+ *  durable state intact.
+ *
+ * @return true on success, false on I/O error ( the durable state is then left untouched )
+ */
+bool osal::posix::PersistentCircularBuffer::Sync ()
+{
+    const uint64_t write_position = write_position_;
+    const uint64_t read_position  = __atomic_load_n(&read_position_, __ATOMIC_ACQUIRE);
+
+    if ( write_position == durable_write_position_ && read_position == durable_read_position_ ) {
+        return true;
+    }
+    if ( write_position != durable_write_position_ ) {
+        // ... pending bytes are contiguous in the mirrored mapping, msync wants a page aligned start ...
+        const size_t start  = (size_t) (durable_write_position_ % (uint64_t) length_);
+        const size_t offset = start % header_length_;
+        if ( 0 != msync((char*) buffer_ + start - offset, (size_t) (write_position - durable_write_position_) + offset, MS_SYNC) ) {
+            perror("msync data");
+            return false;
+        }
+    }
+    header_->write_position_ = write_position;
+    header_->read_position_  = read_position;
+    if ( 0 != msync(header_, header_length_, MS_SYNC) ) {
+        perror("msync header");
+        return false;
+    }
+    durable_write_position_ = write_position;
+    durable_read_position_  = read_position;
+    pending_since_ms_       = -1;
+    return true;
+}
+
+/**
+ * @brief Free space for the producer, bounded by the durable read position
+ *
+ * @param a_wanted When less than this is free, try to reclaim the space already released by the consumer
+ */
+size_t osal::posix::PersistentCircularBuffer::Space (size_t a_wanted)
+{
+    size_t space = length_ - (size_t) (write_position_ - durable_read_position_);
+    if ( space < a_wanted && __atomic_load_n(&read_position_, __ATOMIC_ACQUIRE) != durable_read_position_ ) {
+        Sync();
+        space = length_ - (size_t) (write_position_ - durable_read_position_);
+    }
+    return space;
+}
+
+/**
+ * Produce bytes in buffer
+ *
+ *  The bytes are visible to the consumer at once, and durable according to the sync policy.
+ *
+ * @param a_amount Number of bytes to produce
+ */
+void osal::posix::PersistentCircularBuffer::Produce (size_t a_amount)
+{
+    __atomic_store_n(&write_position_, write_position_ + (uint64_t) a_amount, __ATOMIC_RELEASE);
+
+    if ( write_position_ - durable_write_position_ >= (uint64_t) policy_.bytes_ ) {
+        Sync();
+    } else {
+        SyncIfDue();
+    }
+}
+
+/**
+ * @brief Sync if the oldest pending byte is older than the policy interval, producer thread only
+ *
+ *  #Produce calls this, an idle producer must call it too or its pending bytes wait for the
+ *  next #Produce.
+ *
+ * @return false on I/O error, true otherwise ( synced or nothing due )
+ */
+bool osal::posix::PersistentCircularBuffer::SyncIfDue ()
+{
+    if ( 0 == policy_.interval_ms_ || write_position_ == durable_write_position_ ) {
+        return true;
+    }
+    const int64_t now = NowMs();
+    if ( -1 == pending_since_ms_ ) {
+        pending_since_ms_ = now;
+        return true;
+    }
+    if ( now - pending_since_ms_ < policy_.interval_ms_ ) {
+        return true;
+    }
+    return Sync();
+}
+
+/**
+ * Helper routine to copy bytes to buffer
+ *
+ * @param a_source Source buffer
+ * @param a_length Number of bytes in source buffer
+ * @return true if bytes copied, false if there was insufficient space
+ */
+bool osal::posix::PersistentCircularBuffer::ProduceBytes (const void* a_source, size_t a_length)
+{
+    if ( Space(a_length) < a_length ) {
+        return false;
+    }
+    memcpy((char*) buffer_ + (write_position_ % (uint64_t) length_), a_source, a_length);
+    Produce(a_length);
+    return true;
+}
+
+/**
+ * @return Monotonic clock in milliseconds
+ */
+int64_t osal::posix::PersistentCircularBuffer::NowMs ()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + (int64_t) ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,194 @@
+#pragma once
+/**
+ * @file posix_persistent_circular_buffer.h Crash recoverable file backed circular buffer - header and inline functions
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Single producer / single consumer ring kept in a regular file, a local write-ahead spool.
+ *
+ * The file holds one header page followed by the data, the data is mapped twice back to back
+ * (as in #CircularBuffer) so every read and write is contiguous. The header only ever holds
+ * *durable* positions: #Sync first flushes the produced bytes, then rewrites and flushes the
+ * header, so after a crash #Init reattaches to the file and resumes from the last durable
+ * read position with every byte up to the last durable write position intact. Bytes consumed
+ * after the last #Sync are delivered again (at least once).
+ *
+ * The producer never overwrites bytes beyond the durable read position, space released by
+ * the consumer is reclaimed by the producer with a header only #Sync when it runs out of room.
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_PERSISTENT_CIRCULAR_BUFFER_H
+#define NRS_OSAL_POSIX_POSIX_PERSISTENT_CIRCULAR_BUFFER_H
+
+#include "osal/osalite.h"
+
+#include <stdint.h>
+#include <stdlib.h>   // for NULL
+#include <sys/mman.h> // for mmap
+
+namespace osal
+{
+    namespace posix
+    {
+        class PersistentCircularBuffer
+        {
+        public: // Data Type(s)
+
+            /**
+             * @brief When #Produce makes the pending bytes durable.
+             *
+             *  The interval is only checked by #Produce and #SyncIfDue, a producer that may go
+             *  idle with bytes pending calls #SyncIfDue from its timer or wait loop.
+             */
+            struct SyncPolicy {
+                size_t  bytes_;       //!< Sync once this many bytes are pending, 0 syncs on every #Produce
+                int64_t interval_ms_; //!< ... or once the oldest pending byte is this old, 0 disables the timer
+            };
+
+        protected: // Data Type(s)
+
+            /**
+             * @brief Durable state, lives in the first page of the file.
+             */
+            struct Header {
+                uint32_t magic_;
+                uint32_t version_;
+                uint64_t length_;
+                uint64_t write_position_;
+                uint64_t read_position_;
+            };
+
+        protected: // Const Data
+
+            static const uint32_t k_magic_   = 0x4f434250; // 'OCBP'
+            static const uint32_t k_version_ = 1;
+
+        protected: // data
+
+            Header*              header_;
+            void*                buffer_;
+            size_t               header_length_;
+            size_t               length_;
+            int                  fd_;
+            SyncPolicy           policy_;
+            alignas(64) uint64_t write_position_;         //!< Producer owned
+            uint64_t             durable_write_position_; //!< Producer owned, write position last stored in the header
+            uint64_t             durable_read_position_;  //!< Producer owned, read position last stored in the header
+            int64_t              pending_since_ms_;       //!< Producer owned, age of the oldest pending byte, -1 when none
+            alignas(64) uint64_t read_position_;          //!< Consumer owned
+
+        public: // methods
+
+            PersistentCircularBuffer ();
+            virtual ~PersistentCircularBuffer();
+
+            bool  Init      (const char* a_data_path, size_t a_length, const SyncPolicy& a_policy);
+            void  Close     ();
+
+        public: // methods
+
+            // Reading (consuming), one thread
+            void*   Tail         (size_t* a_available_bytes);
+            void    Consume      (size_t  a_amount);
+
+            // Writing (producing), one thread
+            bool    ProduceBytes (const void* a_source, size_t a_length);
+            void*   Head         (size_t* a_available_bytes);
+            void    Produce      (size_t  a_amount);
+            bool    Sync         ();
+            bool    SyncIfDue    ();
+
+            size_t   Size          () const;
+            bool     IsOperational () const;
+
+        protected:
+
+            void    Init      ();
+            bool    Map       (int a_fd, size_t a_length);
+            size_t  Space     (size_t a_wanted);
+
+            static int64_t NowMs ();
+
+        };
+
+    } // endof namespace posix
+} // endof namespace osal
+
+inline osal::posix::PersistentCircularBuffer::PersistentCircularBuffer ()
+{
+    Init();
+}
+
+inline osal::posix::PersistentCircularBuffer::~PersistentCircularBuffer ()
+{
+    Close();
+}
+
+inline size_t osal::posix::PersistentCircularBuffer::Size () const
+{
+    return length_;
+}
+
+inline bool osal::posix::PersistentCircularBuffer::IsOperational () const
+{
+    return NULL != header_ && length_ > 0;
+}
+
+/**
+ * Access end of buffer
+ *
+ * @param a_available_bytes On output, the number of bytes ready for reading
+ * @return Pointer to the first bytes ready for reading, or NULL if buffer is empty
+ */
+inline void* osal::posix::PersistentCircularBuffer::Tail (size_t* a_available_bytes)
+{
+    const uint64_t read_position = read_position_;
+    *a_available_bytes = (size_t) (__atomic_load_n(&write_position_, __ATOMIC_ACQUIRE) - read_position);
+    if ( 0 == *a_available_bytes ) {
+        return NULL;
+    }
+    return (void*)((char*) buffer_ + (read_position % (uint64_t) length_));
+}
+
+/**
+ * Consume bytes in buffer
+ *
+ *  The new position becomes durable with the next #Sync of the producer.
+ *
+ * @param a_amount Number of bytes to consume
+ */
+inline void osal::posix::PersistentCircularBuffer::Consume (size_t a_amount)
+{
+    __atomic_store_n(&read_position_, read_position_ + (uint64_t) a_amount, __ATOMIC_RELEASE);
+}
+
+/**
+ * Access front of buffer
+ *
+ * @param a_available_bytes On output, the number of bytes ready for writing
+ * @return Pointer to the first bytes ready for writing, or NULL if buffer is full
+ */
+inline void* osal::posix::PersistentCircularBuffer::Head (size_t* a_available_bytes)
+{
+    *a_available_bytes = Space(1);
+    if ( 0 == *a_available_bytes ) {
+        return NULL;
+    }
+    return (void*)((char*) buffer_ + (write_position_ % (uint64_t) length_));
+}
+
+#endif // NRS_OSAL_POSIX_POSIX_PERSISTENT_CIRCULAR_BUFFER_H
@@ -0,0 +1,196 @@
+#pragma once
+/**
+ * @file posix_rw_lock.h Reader-writer lock with striped reader counters - header only
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Each thread counts itself in one of #k_stripes_ counters, each on its own cache line, so
+ * readers on different cores do not bounce a shared line. A reader publishes itself in its
+ * stripe and then checks the writer flag; a writer raises the flag and then waits for every
+ * stripe to drain. Both sides use sequentially consistent accesses, so at least one of them
+ * sees the other.
+ *
+ * Reads are cheap and writes are expensive, a writer scans every stripe: meant for state that
+ * is read all the time and written at startup or on reconfiguration. Writers have priority,
+ * new readers wait while a writer is waiting. Not recursive.
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_RW_LOCK_H
+#define NRS_OSAL_POSIX_POSIX_RW_LOCK_H
+
+#include "osal/posix/posix_spin_mutex.h"
+#include "osal/posix/posix_futex.h"
+
+#include <stdint.h>
+
+namespace osal
+{
+    namespace posix
+    {
+
+        class RWLock
+        {
+
+        public: // Static Const
+
+            static const uint32_t k_stripes_ = 64;
+
+        protected: // Data Type(s)
+
+            typedef struct {
+                volatile uint32_t count_;       //!< Readers of this stripe holding the lock
+                uint8_t           padding_[60]; //!< One stripe per cache line, the lock may be heap allocated
+            } Stripe;
+
+        protected: // data
+
+            Stripe            stripes_[k_stripes_];
+            SpinMutex         writers_;        //!< Serializes writers
+            volatile uint32_t writer_;         //!< Futex word, non zero while a writer holds, or waits for, the lock
+            volatile uint32_t drain_sequence_; //!< Futex word, bumped by readers leaving while #writer_ is set
+
+        public: // Data Type(s)
+
+            /**
+             * @brief Holds the lock shared for its lifetime.
+             */
+            class ReadGuard
+            {
+            protected:
+                RWLock& lock_;
+            public:
+                ReadGuard  (RWLock& a_lock) : lock_(a_lock) { lock_.ReadLock(); }
+                ~ReadGuard () { lock_.ReadUnlock(); }
+            };
+
+            /**
+             * @brief Holds the lock exclusive for its lifetime.
+             */
+            class WriteGuard
+            {
+            protected:
+                RWLock& lock_;
+            public:
+                WriteGuard  (RWLock& a_lock) : lock_(a_lock) { lock_.WriteLock(); }
+                ~WriteGuard () { lock_.WriteUnlock(); }
+            };
+
+        public: // methods
+
+            RWLock ();
+
+            void  ReadLock    ();
+            void  ReadUnlock  ();
+            void  WriteLock   ();
+            void  WriteUnlock ();
+
+        protected:
+
+            static uint32_t ThreadStripe ();
+
+        };
+
+    } // endof namespace posix
+} // endof namespace osal
+
+inline osal::posix::RWLock::RWLock ()
+{
+    for ( uint32_t i = 0; i < k_stripes_; ++i ) {
+        stripes_[i].count_ = 0;
+    }
+    writer_         = 0;
+    drain_sequence_ = 0;
+}
+
+/**
+ * @brief Acquire the lock shared
+ */
+inline void osal::posix::RWLock::ReadLock ()
+{
+    volatile uint32_t* count = &stripes_[ThreadStripe()].count_;
+    for ( ;; ) {
+        __atomic_add_fetch(count, 1, __ATOMIC_SEQ_CST);
+        if ( 0 == __atomic_load_n(&writer_, __ATOMIC_SEQ_CST) ) {
+            return;
+        }
+        // ... a writer is in, or about to be, step aside until it leaves ...
+        ReadUnlock();
+        while ( 0 != __atomic_load_n(&writer_, __ATOMIC_SEQ_CST) ) {
+            osal::posix::Futex::Wait(&writer_, 1);
+        }
+    }
+}
+
+/**
+ * @brief Release the lock acquired with #ReadLock
+ */
+inline void osal::posix::RWLock::ReadUnlock ()
+{
+    __atomic_sub_fetch(&stripes_[ThreadStripe()].count_, 1, __ATOMIC_SEQ_CST);
+    if ( 0 != __atomic_load_n(&writer_, __ATOMIC_SEQ_CST) ) {
+        __atomic_add_fetch(&drain_sequence_, 1, __ATOMIC_SEQ_CST);
+        osal::posix::Futex::Wake(&drain_sequence_);
+    }
+}
+
+/**
+ * @brief Acquire the lock exclusive, waits for the readers already in
+ */
+inline void osal::posix::RWLock::WriteLock ()
+{
+    writers_.Lock();
+    __atomic_store_n(&writer_, 1, __ATOMIC_SEQ_CST);
+    for ( uint32_t i = 0; i < k_stripes_; ++i ) {
+        int spins = 0;
+        for ( ;; ) {
+            const uint32_t sequence = __atomic_load_n(&drain_sequence_, __ATOMIC_SEQ_CST);
+            if ( 0 == __atomic_load_n(&stripes_[i].count_, __ATOMIC_SEQ_CST) ) {
+                break;
+            }
+            if ( spins++ < SpinMutex::k_spin_limit_ ) {
+                SpinMutex::CpuRelax();
+            } else {
+                osal::posix::Futex::Wait(&drain_sequence_, sequence);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Release the lock acquired with #WriteLock
+ */
+inline void osal::posix::RWLock::WriteUnlock ()
+{
+    __atomic_store_n(&writer_, 0, __ATOMIC_SEQ_CST);
+    osal::posix::Futex::Wake(&writer_);
+    writers_.Unlock();
+}
+
+/**
+ * @return Stripe of the calling thread, handed out round robin on first use
+ */
+inline uint32_t osal::posix::RWLock::ThreadStripe ()
+{
+    static uint32_t          next   = 0;
+    static __thread uint32_t stripe = 0; // ... stripe + 1, 0 until assigned ...
+    if ( 0 == stripe ) {
+        stripe = ( __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED) % k_stripes_ ) + 1;
+    }
+    return stripe - 1;
+}
+
+#endif // NRS_OSAL_POSIX_POSIX_RW_LOCK_H
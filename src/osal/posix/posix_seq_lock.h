@@ -0,0 +1,133 @@
+#pragma once
+/**
+ * @file posix_seq_lock.h Sequence lock for small trivially copyable snapshots - header only
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Readers never write shared memory: they copy the value between two reads of the sequence
+ * and retry if it was odd, a write in progress, or changed. Writers are serialized by a
+ * SpinMutex and make the sequence odd while they copy.
+ *
+ * The value is kept as 64 bit words accessed atomically, so a torn read is only ever a
+ * discarded copy, never a data race.
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_SEQ_LOCK_H
+#define NRS_OSAL_POSIX_POSIX_SEQ_LOCK_H
+
+#include "osal/posix/posix_spin_mutex.h"
+
+#include <stdint.h>
+#include <string.h> // memcpy
+
+#include <type_traits>
+
+namespace osal
+{
+    namespace posix
+    {
+
+        template <typename T>
+        class SeqLock
+        {
+
+            static_assert(std::is_trivially_copyable<T>::value, "SeqLock value must be trivially copyable");
+
+        protected: // Const
+
+            static const size_t k_words_ = ( sizeof(T) + sizeof(uint64_t) - 1 ) / sizeof(uint64_t);
+
+        protected: // data
+
+            volatile uint32_t sequence_; //!< Odd while a write is in progress
+            SpinMutex         writers_;
+            uint64_t          words_[k_words_];
+
+        public: // methods
+
+            SeqLock (const T& a_value = T());
+
+            T     Load  () const;
+            void  Store (const T& a_value);
+
+        };
+
+    } // endof namespace posix
+} // endof namespace osal
+
+/**
+ * @param a_value Initial value
+ */
+template <typename T>
+inline osal::posix::SeqLock<T>::SeqLock (const T& a_value)
+{
+    sequence_ = 0;
+    memset(words_, 0, sizeof(words_));
+    memcpy(words_, &a_value, sizeof(T));
+}
+
+/**
+ * @return A consistent copy of the value, retries while a write is in progress
+ */
+template <typename T>
+inline T osal::posix::SeqLock<T>::Load () const
+{
+    uint64_t words[k_words_];
+    for ( ;; ) {
+        const uint32_t before = __atomic_load_n(&sequence_, __ATOMIC_ACQUIRE);
+        if ( 0 != ( before & 1 ) ) {
+            SpinMutex::CpuRelax();
+            continue;
+        }
+        for ( size_t i = 0; i < k_words_; ++i ) {
+            words[i] = __atomic_load_n(&words_[i], __ATOMIC_RELAXED);
+        }
+        // ... the copies above may not move below the re-check ...
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if ( before == __atomic_load_n(&sequence_, __ATOMIC_RELAXED) ) {
+            break;
+        }
+    }
+    T value;
+    memcpy(&value, words, sizeof(T));
+    return value;
+}
+
+/**
+ * @brief Replace the value, may be called from several threads
+ *
+ * @param a_value New value
+ */
+template <typename T>
+inline void osal::posix::SeqLock<T>::Store (const T& a_value)
+{
+    uint64_t words[k_words_] = { 0 };
+    memcpy(words, &a_value, sizeof(T));
+
+    writers_.Lock();
+    const uint32_t sequence = __atomic_load_n(&sequence_, __ATOMIC_RELAXED);
+    __atomic_store_n(&sequence_, sequence + 1, __ATOMIC_RELAXED);
+    // ... the odd sequence is visible before any word changes ...
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for ( size_t i = 0; i < k_words_; ++i ) {
+        __atomic_store_n(&words_[i], words[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&sequence_, sequence + 2, __ATOMIC_RELEASE);
+    writers_.Unlock();
+}
+
+#endif // NRS_OSAL_POSIX_POSIX_SEQ_LOCK_H
@@ -0,0 +1,238 @@
+/**
+ * @file posix_shared_circular_buffer.cc Lockless cross-process circular buffer - implementation
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "osal/posix/posix_shared_circular_buffer.h"
+#include "osal/debug_trace.h"
+#include <string.h>   // for memcpy
+#include <unistd.h>   // for close, ftruncate
+#include <fcntl.h>    // for O_* constants
+#include <stdio.h>    // for perror
+#include <sys/stat.h> // for fstat
+
+#if defined(__linux__)
+    #include <sys/syscall.h> // for SYS_memfd_create
+    #include <linux/memfd.h> // for MFD_CLOEXEC
+#endif
+
+#ifdef __ANDROID__
+#undef perror
+#define perror(V) DEBUGTRACE("SharedCircularBuffer", V)
+#endif
+
+void osal::posix::SharedCircularBuffer::Init ()
+{
+    control_               = NULL;
+    buffer_                = NULL;
+    control_length_        = 0;
+    length_                = 0;
+    fd_                    = -1;
+    cached_read_position_  = 0;
+}
+
+/**
+ * @brief Create a new shared buffer
+ *
+ * @param a_name   POSIX shared memory name ( "/name" ), or NULL for an anonymous object whose
+ *                 descriptor is handed to the other process
+ * @param a_length Length of buffer, rounded up to a multiple of the page size
+ */
+bool osal::posix::SharedCircularBuffer::Create (const char* a_name, size_t a_length)
+{
+    const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    int fd;
+
+    Close();
+
+    if ( NULL != a_name ) {
+        fd = shm_open(a_name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+    } else {
+#if defined(__linux__) && defined(SYS_memfd_create)
+        fd = (int) syscall(SYS_memfd_create, "osal-shared-circular-buffer", MFD_CLOEXEC);
+#else
+        char szTmp[64];
+        snprintf(szTmp, sizeof(szTmp), "/osal-scb-%d-%p", (int) getpid(), (void*) this);
+        fd = shm_open(szTmp, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+        if ( fd >= 0 ) {
+            shm_unlink(szTmp);
+        }
+#endif
+    }
+    if ( fd < 0 ) {
+        perror("shm_open");
+        return false;
+    }
+
+    const size_t length = ((a_length + page_size - 1) / page_size) * page_size;
+    if ( 0 != ftruncate(fd, (off_t) page_size + length) ) {
+        perror("ftruncate");
+        close(fd);
+        if ( NULL != a_name ) {
+            shm_unlink(a_name);
+        }
+        return false;
+    }
+    if ( false == Map(fd, length) ) {
+        close(fd);
+        if ( NULL != a_name ) {
+            shm_unlink(a_name);
+        }
+        return false;
+    }
+    control_->version_        = k_version_;
+    control_->length_         = (uint64_t) length;
+    control_->write_position_ = 0;
+    control_->read_position_  = 0;
+    // ... attaching processes check the magic last ...
+    __atomic_store_n(&control_->magic_, k_magic_, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * @brief Attach to a buffer created by another process
+ *
+ * @param a_name POSIX shared memory name given to #Create
+ */
+bool osal::posix::SharedCircularBuffer::Attach (const char* a_name)
+{
+    Close();
+
+    const int fd = shm_open(a_name, O_RDWR, 0);
+    if ( fd < 0 ) {
+        perror("shm_open");
+        return false;
+    }
+    if ( false == Attach(fd) ) {
+        close(fd);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Attach to a buffer created by another process
+ *
+ * @param a_fd Descriptor received from the creator, owned by this object on success
+ */
+bool osal::posix::SharedCircularBuffer::Attach (int a_fd)
+{
+    const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    struct stat   st;
+
+    if ( a_fd != fd_ ) {
+        Close();
+    }
+    if ( 0 != fstat(a_fd, &st) || st.st_size <= (off_t) page_size ) {
+        return false;
+    }
+    Control* control = (Control*) mmap(NULL, page_size, PROT_READ, MAP_SHARED, a_fd, 0);
+    if ( control == MAP_FAILED ) {
+        perror("map control");
+        return false;
+    }
+    const bool valid = __atomic_load_n(&control->magic_, __ATOMIC_ACQUIRE) == k_magic_
+                            && control->version_ == k_version_
+                            && (off_t) (control->length_ + page_size) == st.st_size;
+    const size_t length = (size_t) control->length_;
+    munmap(control, page_size);
+    if ( false == valid ) {
+        return false;
+    }
+    if ( false == Map(a_fd, length) ) {
+        return false;
+    }
+    cached_read_position_ = __atomic_load_n(&control_->read_position_, __ATOMIC_ACQUIRE);
+    return true;
+}
+
+/**
+ * @brief Map the control page, and the data twice back to back
+ */
+bool osal::posix::SharedCircularBuffer::Map (int a_fd, size_t a_length)
+{
+    const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+
+    uint8_t* base = (uint8_t*) mmap(NULL, page_size + (size_t) a_length * 2, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if ( base == MAP_FAILED ) {
+        perror("map anon");
+        return false;
+    }
+    control_length_ = page_size;
+    length_         = a_length;
+
+    if ( MAP_FAILED == mmap(base, page_size, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_SHARED, a_fd, 0)
+        || MAP_FAILED == mmap(base + page_size, a_length, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_SHARED, a_fd, page_size)
+        || MAP_FAILED == mmap(base + page_size + a_length, a_length, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_SHARED, a_fd, page_size) ) {
+        perror("map shared");
+        munmap(base, page_size + (size_t) a_length * 2);
+        control_length_ = 0;
+        length_         = 0;
+        return false;
+    }
+    control_ = (Control*) base;
+    buffer_  = base + page_size;
+    fd_      = a_fd;
+    return true;
+}
+
+/**
+ * @brief Detach from the buffer
+ *
+ * The shared memory name, if any, is kept until #Unlink.
+ */
+void osal::posix::SharedCircularBuffer::Close ()
+{
+    if ( NULL != control_ ) {
+        munmap(control_, control_length_ + (size_t) length_ * 2);
+    }
+    if ( -1 != fd_ ) {
+        close(fd_);
+    }
+    Init();
+}
+
+/**
+ * @brief Remove a named buffer, processes already attached keep working
+ */
+bool osal::posix::SharedCircularBuffer::Unlink (const char* a_name)
+{
+    return 0 == shm_unlink(a_name);
+}
+
+/**
+ * Helper routine to copy bytes to buffer
+ *
+ * @param a_source Source buffer
+ * @param a_length Number of bytes in source buffer
+ * @return true if bytes copied, false if there was insufficient space
+ */
+bool osal::posix::SharedCircularBuffer::ProduceBytes (const void* a_source, size_t a_length)
+{
+    const uint64_t write_position = control_->write_position_;
+    if ( (uint64_t) length_ - (write_position - cached_read_position_) < (uint64_t) a_length ) {
+        cached_read_position_ = __atomic_load_n(&control_->read_position_, __ATOMIC_ACQUIRE);
+        if ( (uint64_t) length_ - (write_position - cached_read_position_) < (uint64_t) a_length ) {
+            return false;
+        }
+    }
+    memcpy((char*) buffer_ + (write_position % (uint64_t) length_), a_source, a_length);
+    Produce(a_length);
+    return true;
+}
@@ -0,0 +1,195 @@
+#pragma once
+/**
+ * @file posix_shared_circular_buffer.h Lockless cross-process circular buffer - header and inline functions
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Single producer / single consumer ring shared between processes on the same host.
+ *
+ * The shared memory object holds one control page followed by the data, the data is mapped
+ * twice back to back (as in #CircularBuffer) so every read and write is contiguous. The
+ * positions live in the control page, on separate cache lines, so the consumer may sit in
+ * another process: either attach by name (POSIX shared memory) or receive the descriptor
+ * (SCM_RIGHTS) of an anonymous buffer and attach to it.
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_SHARED_CIRCULAR_BUFFER_H
+#define NRS_OSAL_POSIX_POSIX_SHARED_CIRCULAR_BUFFER_H
+
+#include "osal/osalite.h"
+
+#include <stdint.h>
+#include <stdlib.h>   // for NULL
+#include <sys/mman.h> // for mmap
+
+namespace osal
+{
+    namespace posix
+    {
+        class SharedCircularBuffer
+        {
+        protected: // Data Type(s)
+
+            /**
+             * @brief Shared state, lives in the first page of the shared memory object.
+             */
+            struct Control {
+                uint32_t             magic_;
+                uint32_t             version_;
+                uint64_t             length_;
+                alignas(64) uint64_t write_position_; //!< Producer owned
+                alignas(64) uint64_t read_position_;  //!< Consumer owned
+            };
+
+        protected: // Const Data
+
+            static const uint32_t k_magic_   = 0x4f43424d; // 'OCBM'
+            static const uint32_t k_version_ = 1;
+
+        protected: // data
+
+            Control* control_;
+            void*    buffer_;
+            size_t   control_length_;
+            size_t   length_;
+            int      fd_;
+            uint64_t cached_read_position_;  //!< Producer copy of the shared read position, for #ProduceBytes
+
+        public: // methods
+
+            SharedCircularBuffer ();
+            virtual ~SharedCircularBuffer();
+
+            bool  Create    (const char* a_name, size_t a_length);
+            bool  Attach    (const char* a_name);
+            bool  Attach    (int a_fd);
+            void  Close     ();
+
+            static bool Unlink (const char* a_name);
+
+        public: // methods
+
+            // Reading (consuming), one process
+            void*   Tail         (size_t* a_available_bytes);
+            void    Consume      (size_t  a_amount);
+
+            // Writing (producing), one process
+            bool    ProduceBytes (const void* a_source, size_t a_length);
+            void*   Head         (size_t* a_available_bytes);
+            void    Produce      (size_t  a_amount);
+
+            size_t   Size              () const;
+            int      GetFileDescriptor () const;
+            bool     IsOperational     () const;
+
+        protected:
+
+            void  Init    ();
+            bool  Map     (int a_fd, size_t a_length);
+
+        };
+
+    } // endof namespace posix
+} // endof namespace osal
+
+inline osal::posix::SharedCircularBuffer::SharedCircularBuffer ()
+{
+    Init();
+}
+
+inline osal::posix::SharedCircularBuffer::~SharedCircularBuffer ()
+{
+    Close();
+}
+
+inline size_t osal::posix::SharedCircularBuffer::Size () const
+{
+    return length_;
+}
+
+/**
+ * @return The shared memory descriptor, pass it to another process to let it #Attach
+ */
+inline int osal::posix::SharedCircularBuffer::GetFileDescriptor () const
+{
+    return fd_;
+}
+
+inline bool osal::posix::SharedCircularBuffer::IsOperational () const
+{
+    return NULL != control_ && length_ > 0;
+}
+
+/**
+ * Access end of buffer
+ *
+ * @param a_available_bytes On output, the number of bytes ready for reading
+ * @return Pointer to the first bytes ready for reading, or NULL if buffer is empty
+ */
+inline void* osal::posix::SharedCircularBuffer::Tail (size_t* a_available_bytes)
+{
+    // ... always reloaded, a consumer waiting for the rest of a message must see it arrive ...
+    const uint64_t read_position  = control_->read_position_;
+    const uint64_t write_position = __atomic_load_n(&control_->write_position_, __ATOMIC_ACQUIRE);
+    if ( write_position == read_position ) {
+        *a_available_bytes = 0;
+        return NULL;
+    }
+    *a_available_bytes = (size_t) (write_position - read_position);
+    return (void*)((char*) buffer_ + (read_position % (uint64_t) length_));
+}
+
+/**
+ * Consume bytes in buffer
+ *
+ * @param a_amount Number of bytes to consume
+ */
+inline void osal::posix::SharedCircularBuffer::Consume (size_t a_amount)
+{
+    __atomic_store_n(&control_->read_position_, control_->read_position_ + (uint64_t) a_amount, __ATOMIC_RELEASE);
+}
+
+/**
+ * Access front of buffer
+ *
+ * @param a_available_bytes On output, the number of bytes ready for writing
+ * @return Pointer to the first bytes ready for writing, or NULL if buffer is full
+ */
+inline void* osal::posix::SharedCircularBuffer::Head (size_t* a_available_bytes)
+{
+    // ... always reloaded, a producer waiting for room for a whole message must see it free up ...
+    const uint64_t write_position = control_->write_position_;
+    cached_read_position_ = __atomic_load_n(&control_->read_position_, __ATOMIC_ACQUIRE);
+    if ( write_position - cached_read_position_ == (uint64_t) length_ ) {
+        *a_available_bytes = 0;
+        return NULL;
+    }
+    *a_available_bytes = (size_t) ((uint64_t) length_ - (write_position - cached_read_position_));
+    return (void*)((char*) buffer_ + (write_position % (uint64_t) length_));
+}
+
+/**
+ * Produce bytes in buffer
+ *
+ * @param a_amount Number of bytes to produce
+ */
+inline void osal::posix::SharedCircularBuffer::Produce (size_t a_amount)
+{
+    __atomic_store_n(&control_->write_position_, control_->write_position_ + (uint64_t) a_amount, __ATOMIC_RELEASE);
+}
+
+#endif // NRS_OSAL_POSIX_POSIX_SHARED_CIRCULAR_BUFFER_H
@@ -0,0 +1,199 @@
+#pragma once
+/**
+ * @file posix_spin_mutex.h Futex mutex that spins before it parks - header only
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * The whole mutex is one 32 bit word: 0 free, 1 locked, 2 locked and someone may be parked.
+ * Uncontended, locking is one compare and swap and unlocking one exchange. A contended lock
+ * spins for a short while, critical sections are usually shorter than a trip to the kernel,
+ * then parks on the futex. Unlock only enters the kernel when the word says 2.
+ *
+ * Debug builds, or builds with OSAL_MUTEX_ERRORCHECK, keep PTHREAD_MUTEX_ERRORCHECK mutexes
+ * in Mutex and Worker, so relocking and foreign unlocks are still reported there. Without a
+ * futex the parking is a sleep, so Mutex and Worker stay on pthread mutexes and conditions
+ * there too: OSAL_MUTEX_PTHREAD selects them.
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_SPIN_MUTEX_H
+#define NRS_OSAL_POSIX_POSIX_SPIN_MUTEX_H
+
+#include "osal/posix/posix_futex.h"
+
+#include <stdint.h>
+
+#if defined(DEBUG) && !defined(OSAL_MUTEX_ERRORCHECK)
+    #define OSAL_MUTEX_ERRORCHECK 1
+#endif
+
+#if ( defined(OSAL_MUTEX_ERRORCHECK) || !defined(__linux__) ) && !defined(OSAL_MUTEX_PTHREAD)
+    #define OSAL_MUTEX_PTHREAD 1
+#endif
+
+namespace osal
+{
+    namespace posix
+    {
+
+        class SpinMutex
+        {
+
+        public: // Static Const
+
+            static const int k_spin_limit_ = 100; //!< Pauses before parking
+
+        protected: // data
+
+            volatile uint32_t state_;
+
+        public: // methods
+
+            SpinMutex ();
+
+            void  Lock    ();
+            bool  TryLock ();
+            void  Unlock  ();
+
+            static void CpuRelax ();
+
+        };
+
+        /**
+         * @brief Condition variable for a #SpinMutex, a sequence bumped by every wake-up.
+         */
+        class SpinCondition
+        {
+
+        protected: // data
+
+            volatile uint32_t sequence_;
+
+        public: // methods
+
+            SpinCondition ();
+
+            void  Wait      (SpinMutex& a_mutex);
+            void  Signal    ();
+            void  Broadcast ();
+
+        };
+
+    } // endof namespace posix
+} // endof namespace osal
+
+inline osal::posix::SpinMutex::SpinMutex ()
+{
+    state_ = 0;
+}
+
+/**
+ * @brief Acquire the mutex, spinning for a while before parking
+ */
+inline void osal::posix::SpinMutex::Lock ()
+{
+    uint32_t state = 0;
+    if ( true == __atomic_compare_exchange_n(&state_, &state, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) ) {
+        return;
+    }
+    for ( int i = 0; i < k_spin_limit_ && 2 != state; ++i ) {
+        CpuRelax();
+        state = __atomic_load_n(&state_, __ATOMIC_RELAXED);
+        if ( 0 == state && true == __atomic_compare_exchange_n(&state_, &state, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED) ) {
+            return;
+        }
+    }
+    // ... from here on the word stays 2 while we may be parked, so Unlock wakes us ...
+    state = __atomic_exchange_n(&state_, 2, __ATOMIC_ACQUIRE);
+    while ( 0 != state ) {
+        osal::posix::Futex::Wait(&state_, 2);
+        state = __atomic_exchange_n(&state_, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+/**
+ * @return true if the mutex was free and is now held
+ */
+inline bool osal::posix::SpinMutex::TryLock ()
+{
+    uint32_t state = 0;
+    return __atomic_compare_exchange_n(&state_, &state, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Release the mutex, waking one parked thread if there may be any
+ */
+inline void osal::posix::SpinMutex::Unlock ()
+{
+    if ( 2 == __atomic_exchange_n(&state_, 0, __ATOMIC_RELEASE) ) {
+        osal::posix::Futex::Wake(&state_, 1);
+    }
+}
+
+/**
+ * @brief Tell the CPU we are spinning
+ */
+inline void osal::posix::SpinMutex::CpuRelax ()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__ ("yield" ::: "memory");
+#else
+    __asm__ __volatile__ ("" ::: "memory");
+#endif
+}
+
+inline osal::posix::SpinCondition::SpinCondition ()
+{
+    sequence_ = 0;
+}
+
+/**
+ * @brief Release the mutex, sleep until woken and re-acquire it
+ *
+ *  May return spuriously, the caller re-checks its predicate. The predicate must be changed
+ *  with the mutex held, so the sequence read here precedes the wake-up.
+ *
+ * @param a_mutex Mutex held by the caller
+ */
+inline void osal::posix::SpinCondition::Wait (SpinMutex& a_mutex)
+{
+    const uint32_t sequence = __atomic_load_n(&sequence_, __ATOMIC_RELAXED);
+    a_mutex.Unlock();
+    osal::posix::Futex::Wait(&sequence_, sequence);
+    a_mutex.Lock();
+}
+
+/**
+ * @brief Wake one waiter
+ */
+inline void osal::posix::SpinCondition::Signal ()
+{
+    __atomic_add_fetch(&sequence_, 1, __ATOMIC_SEQ_CST);
+    osal::posix::Futex::Wake(&sequence_, 1);
+}
+
+/**
+ * @brief Wake every waiter
+ */
+inline void osal::posix::SpinCondition::Broadcast ()
+{
+    __atomic_add_fetch(&sequence_, 1, __ATOMIC_SEQ_CST);
+    osal::posix::Futex::Wake(&sequence_);
+}
+
+#endif // NRS_OSAL_POSIX_POSIX_SPIN_MUTEX_H
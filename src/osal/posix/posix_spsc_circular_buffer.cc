@@ -0,0 +1,107 @@
+/**
+ * @file posix_spsc_circular_buffer.cc Lockless single-producer / single-consumer circular buffer - implementation
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "osal/posix/posix_spsc_circular_buffer.h"
+#include <string.h> // for memcpy
+
+void osal::posix::SPSCCircularBuffer::Init ()
+{
+    write_position_        = 0;
+    cached_read_position_  = 0;
+    read_position_         = 0;
+    cached_write_position_ = 0;
+    mask_                  = 0;
+}
+
+/**
+ * @brief Initialise buffer, see CircularBuffer::Init
+ *
+ * @param a_data_path Directory for the temporary backing file, may be NULL when using anonymous memory
+ * @param a_length    Length of buffer, a power of two and a multiple of the page size
+ * @param a_options   Bitmask of CircularBuffer::Options
+ * @return false if the buffer could not be created with exactly a_length bytes
+ */
+bool osal::posix::SPSCCircularBuffer::Init (const char* a_data_path, size_t a_length, uint8_t a_options)
+{
+    Init();
+    if ( 0 == a_length || 0 != ( a_length & ( a_length - 1 ) ) ) {
+        return false;
+    }
+    if ( false == CircularBuffer::Init(a_data_path, a_length, a_options) ) {
+        return false;
+    }
+    // ... rounded up to the page (or huge page) size, the mask would not match ...
+    if ( a_length != length_ ) {
+        Close();
+        return false;
+    }
+    mask_ = (uint64_t) length_ - 1;
+    return true;
+}
+
+/**
+ * @brief Cleanup buffer
+ *
+ * Releases buffer resources.
+ */
+void osal::posix::SPSCCircularBuffer::Close ()
+{
+    CircularBuffer::Close();
+    Init();
+}
+
+/**
+ * @brief Clear buffer
+ *
+ * Resets buffer to original, empty state.
+ *
+ * This is safe for use by consumer while producer is accessing
+ * buffer.
+ */
+void osal::posix::SPSCCircularBuffer::Clear ()
+{
+    size_t count;
+    if ( Tail(&count, length_) != NULL ) { // ... asks for more than there can be, forces a reload ...
+        Consume(count);
+    }
+}
+
+/**
+ * Helper routine to copy bytes to buffer
+ *
+ *  This copies the given bytes to the buffer, and marks them ready for writing.
+ *
+ * @param a_source Source buffer
+ * @param a_length Number of bytes in source buffer
+ * @return true if bytes copied, false if there was insufficient space
+ */
+bool osal::posix::SPSCCircularBuffer::ProduceBytes (const void* a_source, size_t a_length)
+{
+    if ( (uint64_t) length_ - (write_position_ - cached_read_position_) < (uint64_t) a_length ) {
+        cached_read_position_ = __atomic_load_n(&read_position_, __ATOMIC_ACQUIRE);
+        if ( (uint64_t) length_ - (write_position_ - cached_read_position_) < (uint64_t) a_length ) {
+            return false;
+        }
+    }
+    memcpy((char*) buffer_ + (write_position_ & mask_), a_source, a_length);
+    Produce(a_length);
+    return true;
+}
@@ -0,0 +1,172 @@
+#pragma once
+/**
+ * @file posix_spsc_circular_buffer.h Lockless single-producer / single-consumer circular buffer - header and inline functions
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Same contract and mirrored memory as #CircularBuffer, but without the shared fill count.
+ *
+ * The producer owns the write position and the consumer owns the read position, each on its
+ * own cache line. Each side keeps a private copy of the other side's position and only reloads
+ * it, with acquire semantics, when the copy shows fewer bytes than the caller asked for: by
+ * default one, so an empty (or full) buffer. A caller waiting for the rest of a message passes
+ * the number of bytes it needs, otherwise it keeps getting the count of its last reload. In
+ * steady state the only cache line traffic is the release store of each side's own position.
+ *
+ * The length must be a power of two, and a multiple of the page size, so positions map to
+ * offsets with a mask; #Init fails otherwise.
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_SPSC_CIRCULAR_BUFFER_H
+#define NRS_OSAL_POSIX_POSIX_SPSC_CIRCULAR_BUFFER_H
+
+#include "osal/posix/posix_circular_buffer.h"
+
+#include <stdint.h>
+
+namespace osal
+{
+    namespace posix
+    {
+        class SPSCCircularBuffer : protected CircularBuffer
+        {
+        protected: // data
+
+            alignas(64) uint64_t write_position_;        //!< Producer owned
+                        uint64_t cached_read_position_;  //!< Producer copy of #read_position_
+            alignas(64) uint64_t read_position_;         //!< Consumer owned
+                        uint64_t cached_write_position_; //!< Consumer copy of #write_position_
+            alignas(64) uint64_t mask_;                  //!< #length_ - 1
+                        uint8_t  padding_;
+
+        public: // methods
+
+            SPSCCircularBuffer ();
+            virtual ~SPSCCircularBuffer();
+
+            bool  Init      (const char* a_data_path, size_t a_length, uint8_t a_options = Options::None);
+            void  Clear     ();
+            void  Close     ();
+
+            using CircularBuffer::Size;
+            using CircularBuffer::IsOperational;
+
+        public: // methods
+
+            // Reading (consuming)
+            void*   Tail         (size_t* a_available_bytes, size_t a_min_bytes = 1);
+            void    Consume      (size_t  a_amount);
+
+            // Writing (producing)
+            bool    ProduceBytes (const void* a_source, size_t a_length);
+            void*   Head         (size_t* a_available_bytes, size_t a_min_bytes = 1);
+            void    Produce      (size_t  a_amount);
+
+        protected:
+
+            void  Init    ();
+
+        };
+
+    } // endof namespace posix
+} // endof namespace osal
+
+inline osal::posix::SPSCCircularBuffer::SPSCCircularBuffer ()
+{
+    Init();
+}
+
+inline osal::posix::SPSCCircularBuffer::~SPSCCircularBuffer ()
+{
+    Close();
+}
+
+/**
+ * Access end of buffer
+ *
+ *  This gives you a pointer to the end of the buffer, ready
+ *  for reading, and the number of available bytes to read.
+ *
+ *  The write position is only reloaded when the cached one shows less than a_min_bytes.
+ *
+ * @param a_available_bytes On output, the number of bytes ready for reading
+ * @param a_min_bytes       Number of bytes the caller needs, fewer may still be returned
+ * @return Pointer to the first bytes ready for reading, or NULL if buffer is empty
+ */
+inline void* osal::posix::SPSCCircularBuffer::Tail (size_t* a_available_bytes, size_t a_min_bytes)
+{
+    if ( cached_write_position_ - read_position_ < (uint64_t) a_min_bytes ) {
+        cached_write_position_ = __atomic_load_n(&write_position_, __ATOMIC_ACQUIRE);
+        if ( cached_write_position_ == read_position_ ) {
+            *a_available_bytes = 0;
+            return NULL;
+        }
+    }
+    *a_available_bytes = (size_t) (cached_write_position_ - read_position_);
+    return (void*)((char*) buffer_ + (read_position_ & mask_));
+}
+
+/**
+ * Consume bytes in buffer
+ *
+ *  This frees up the just-read bytes, ready for writing again.
+ *
+ * @param a_amount Number of bytes to consume
+ */
+inline void osal::posix::SPSCCircularBuffer::Consume (size_t a_amount)
+{
+    __atomic_store_n(&read_position_, read_position_ + (uint64_t) a_amount, __ATOMIC_RELEASE);
+}
+
+/**
+ * Access front of buffer
+ *
+ *  This gives you a pointer to the front of the buffer, ready
+ *  for writing, and the number of available bytes to write.
+ *
+ *  The read position is only reloaded when the cached one leaves less than a_min_bytes.
+ *
+ * @param a_available_bytes On output, the number of bytes ready for writing
+ * @param a_min_bytes       Number of bytes the caller needs, fewer may still be returned
+ * @return Pointer to the first bytes ready for writing, or NULL if buffer is full
+ */
+inline void* osal::posix::SPSCCircularBuffer::Head (size_t* a_available_bytes, size_t a_min_bytes)
+{
+    if ( (uint64_t) length_ - (write_position_ - cached_read_position_) < (uint64_t) a_min_bytes ) {
+        cached_read_position_ = __atomic_load_n(&read_position_, __ATOMIC_ACQUIRE);
+        if ( write_position_ - cached_read_position_ == (uint64_t) length_ ) {
+            *a_available_bytes = 0;
+            return NULL;
+        }
+    }
+    *a_available_bytes = (size_t) ((uint64_t) length_ - (write_position_ - cached_read_position_));
+    return (void*)((char*) buffer_ + (write_position_ & mask_));
+}
+
+/**
+ * Produce bytes in buffer
+ *
+ *  This marks the given section of the buffer ready for reading.
+ *
+ * @param a_amount Number of bytes to produce
+ */
+inline void osal::posix::SPSCCircularBuffer::Produce (size_t a_amount)
+{
+    __atomic_store_n(&write_position_, write_position_ + (uint64_t) a_amount, __ATOMIC_RELEASE);
+}
+
+#endif // NRS_OSAL_POSIX_POSIX_SPSC_CIRCULAR_BUFFER_H
@@ -0,0 +1,285 @@
+/**
+ * @file posix_task_worker.cc - Worker that runs submitted tasks in order, implementation
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper-osal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "osal/posix/posix_task_worker.h"
+#include "osal/posix/posix_futex.h"
+#include "osal/debug_trace.h"
+
+#include <sched.h> // for sched_yield
+#include <time.h>  // for clock_gettime
+
+/**
+ * @brief An empty handle, #IsValid returns false
+ */
+osal::posix::TaskWorker::Completion::Completion ()
+{
+    /* empty */
+}
+
+/**
+ * @param a_state Shared state of the submitted task
+ */
+osal::posix::TaskWorker::Completion::Completion (const std::shared_ptr<State>& a_state)
+    : state_(a_state)
+{
+    /* empty */
+}
+
+/**
+ * @brief Wait until the task is no longer pending
+ *
+ * @param a_timeout_ms Maximum time to wait in milliseconds, -1 to wait forever
+ * @return true if the task finished, was cancelled or failed, false on timeout or if the
+ *         handle is not #IsValid
+ */
+bool osal::posix::TaskWorker::Completion::Wait (int64_t a_timeout_ms) const
+{
+    if ( nullptr == state_ ) {
+        return false;
+    }
+
+    struct timespec deadline;
+    if ( a_timeout_ms >= 0 ) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec  += a_timeout_ms / 1000;
+        deadline.tv_nsec += (a_timeout_ms % 1000) * 1000000;
+        if ( deadline.tv_nsec >= 1000000000 ) {
+            deadline.tv_sec  += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    bool rv = false;
+    __atomic_add_fetch(&state_->waiters_, 1, __ATOMIC_SEQ_CST);
+    for ( ;; ) {
+        if ( Pending != __atomic_load_n(&state_->status_, __ATOMIC_SEQ_CST) ) {
+            rv = true;
+            break;
+        }
+        struct timespec  remaining;
+        struct timespec* timeout = NULL;
+        if ( a_timeout_ms >= 0 ) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            remaining.tv_sec  = deadline.tv_sec  - now.tv_sec;
+            remaining.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+            if ( remaining.tv_nsec < 0 ) {
+                remaining.tv_sec  -= 1;
+                remaining.tv_nsec += 1000000000;
+            }
+            if ( remaining.tv_sec < 0 ) {
+                break;
+            }
+            timeout = &remaining;
+        }
+        osal::posix::Futex::Wait(&state_->status_, Pending, timeout);
+    }
+    __atomic_sub_fetch(&state_->waiters_, 1, __ATOMIC_SEQ_CST);
+    return rv;
+}
+
+/**
+ * @brief Publish the outcome of a task and release its waiters
+ *
+ * @param a_state  Shared state of the task
+ * @param a_status Final status
+ */
+void osal::posix::TaskWorker::Completion::Complete (State& a_state, Status a_status)
+{
+    __atomic_store_n(&a_state.status_, (uint32_t) a_status, __ATOMIC_SEQ_CST);
+    if ( 0 != __atomic_load_n(&a_state.waiters_, __ATOMIC_SEQ_CST) ) {
+        osal::posix::Futex::Wake(&a_state.status_);
+    }
+}
+
+/**
+ * @brief Create the worker, its thread starts draining right away
+ *
+ * @param a_name          Name of the thread
+ * @param a_high_priority See #Worker
+ */
+osal::posix::TaskWorker::TaskWorker (const char* a_name, bool a_high_priority)
+    : Worker(a_name, a_high_priority)
+{
+    Init();
+}
+
+/**
+ * @brief Create the worker on the given CPUs, NUMA node and scheduling, see #Worker::Placement
+ *
+ * @param a_name      Name of the thread
+ * @param a_placement Where and how the thread runs
+ */
+osal::posix::TaskWorker::TaskWorker (const char* a_name, const Placement& a_placement)
+    : Worker(a_name, a_placement)
+{
+    Init();
+}
+
+osal::posix::TaskWorker::~TaskWorker ()
+{
+    Shutdown();
+}
+
+/**
+ * @brief Reset the queue and start the drain loop, shared by the constructors
+ */
+void osal::posix::TaskWorker::Init ()
+{
+    head_          = NULL;
+    wake_sequence_ = 0;
+    sleeping_      = 0;
+    submitting_    = 0;
+    drain_         = true;
+    accepting_     = ( 0 == startup_err_ );
+    if ( true == accepting_ ) {
+        // ... the vtable is ours by now, the base loop calls our #WorkerFunction ...
+        StartWorkerThread();
+    }
+}
+
+/**
+ * @brief Queue a task, it runs after every task submitted before it
+ *
+ *  After #Shutdown the task is not queued and the handle is already cancelled.
+ *
+ * @param a_task Callable to run on the worker thread
+ * @return Handle to wait for the task
+ */
+osal::posix::TaskWorker::Completion osal::posix::TaskWorker::Submit (const Task& a_task)
+{
+    std::shared_ptr<Completion::State> state = std::make_shared<Completion::State>();
+    state->status_  = Completion::Pending;
+    state->waiters_ = 0;
+
+    __atomic_add_fetch(&submitting_, 1, __ATOMIC_SEQ_CST);
+    if ( false == __atomic_load_n(&accepting_, __ATOMIC_SEQ_CST) ) {
+        __atomic_sub_fetch(&submitting_, 1, __ATOMIC_SEQ_CST);
+        Completion::Complete(*state, Completion::Cancelled);
+        return Completion(state);
+    }
+
+    Node* node   = new Node();
+    node->task_  = a_task;
+    node->state_ = state;
+    node->next_  = __atomic_load_n(&head_, __ATOMIC_RELAXED);
+    while ( false == __atomic_compare_exchange_n(&head_, &node->next_, node, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED) ) {
+        // ... node->next_ was refreshed by the failed exchange ...
+    }
+    __atomic_sub_fetch(&submitting_, 1, __ATOMIC_SEQ_CST);
+
+    // ... pairs with the sleeping_ store and head_ re-check in WorkerFunction ...
+    if ( 0 != __atomic_load_n(&sleeping_, __ATOMIC_SEQ_CST) ) {
+        WakeUp();
+    }
+    return Completion(state);
+}
+
+/**
+ * @brief Stop accepting tasks, finish or cancel the queued ones and join the thread
+ *
+ *  The task in progress always runs to the end. Must not be called from the worker thread.
+ *
+ * @param a_drain true to run the queued tasks, false to cancel them
+ */
+void osal::posix::TaskWorker::Shutdown (bool a_drain)
+{
+    if ( true == __atomic_load_n(&accepting_, __ATOMIC_SEQ_CST) ) {
+        __atomic_store_n(&drain_, a_drain, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&accepting_, false, __ATOMIC_SEQ_CST);
+    }
+    Worker::Shutdown();
+
+    // ... a Submit that got past accepting_ before it dropped may still be pushing ...
+    while ( 0 != __atomic_load_n(&submitting_, __ATOMIC_SEQ_CST) ) {
+        sched_yield();
+    }
+    Run(__atomic_exchange_n(&head_, (Node*) NULL, __ATOMIC_ACQUIRE), true);
+}
+
+/**
+ * @brief The drain loop, returns only once the worker is shutting down and the queue is empty
+ */
+void osal::posix::TaskWorker::WorkerFunction ()
+{
+    for ( ;; ) {
+        Node* batch = __atomic_exchange_n(&head_, (Node*) NULL, __ATOMIC_ACQUIRE);
+        if ( NULL != batch ) {
+            const bool stopping = ( false == __atomic_load_n(&running_, __ATOMIC_SEQ_CST) );
+            Run(batch, stopping && false == __atomic_load_n(&drain_, __ATOMIC_SEQ_CST));
+            continue;
+        }
+        if ( false == __atomic_load_n(&running_, __ATOMIC_SEQ_CST) ) {
+            break;
+        }
+
+        const uint32_t sequence = __atomic_load_n(&wake_sequence_, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&sleeping_, 1, __ATOMIC_SEQ_CST);
+        if ( NULL == __atomic_load_n(&head_, __ATOMIC_SEQ_CST) && true == __atomic_load_n(&running_, __ATOMIC_SEQ_CST) ) {
+            DEBUGTRACE("Worker", "== task worker sleeping\n");
+            osal::posix::Futex::Wait(&wake_sequence_, sequence);
+        }
+        __atomic_store_n(&sleeping_, 0, __ATOMIC_SEQ_CST);
+    }
+}
+
+/**
+ * @brief Release the thread parked in #WorkerFunction
+ */
+void osal::posix::TaskWorker::WakeUp ()
+{
+    __atomic_add_fetch(&wake_sequence_, 1, __ATOMIC_SEQ_CST);
+    osal::posix::Futex::Wake(&wake_sequence_, 1);
+}
+
+/**
+ * @brief Run, or cancel, a batch taken from #head_ and free its nodes
+ *
+ * @param a_batch  Most recent task first, as pushed by #Submit
+ * @param a_cancel true to complete every task as cancelled without running it
+ */
+void osal::posix::TaskWorker::Run (Node* a_batch, bool a_cancel)
+{
+    // ... reverse into submission order ...
+    Node* fifo = NULL;
+    while ( NULL != a_batch ) {
+        Node* next     = a_batch->next_;
+        a_batch->next_ = fifo;
+        fifo           = a_batch;
+        a_batch        = next;
+    }
+
+    while ( NULL != fifo ) {
+        Node* node = fifo;
+        fifo       = node->next_;
+        Completion::Status status = Completion::Cancelled;
+        if ( false == a_cancel ) {
+            try {
+                node->task_();
+                status = Completion::Done;
+            } catch (...) {
+                status = Completion::Failed;
+            }
+        }
+        Completion::Complete(*node->state_, status);
+        delete node;
+    }
+}
@@ -0,0 +1,145 @@
+#pragma once
+/**
+ * @file posix_task_worker.h - Worker that runs submitted tasks in order, declaration
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper-osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Producers push tasks on a lock-free list, the worker thread takes the whole list with a
+ * single exchange and runs it in submission order. The worker parks on a futex when the list
+ * is empty, a producer only issues the wake-up when it finds the worker parked.
+ *
+ * The whole drain loop is a single #WorkerFunction run, started by the constructor, so the
+ * #Worker thread and its #Shutdown join are reused as they are.
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_TASK_WORKER_H
+#define NRS_OSAL_POSIX_POSIX_TASK_WORKER_H
+
+#include "osal/posix/posix_worker.h"
+
+#include <stdint.h>
+
+#include <functional>
+#include <memory>
+
+namespace osal
+{
+    namespace posix
+    {
+        class TaskWorker : public Worker
+        {
+
+        public: // Data Type(s)
+
+            typedef std::function<void()> Task;
+
+            /**
+             * @brief Handle on the outcome of a submitted task.
+             */
+            class Completion
+            {
+
+            public: // Data Type(s)
+
+                enum Status : uint32_t {
+                    Pending   = 0,
+                    Done      = 1,
+                    Cancelled = 2, //!< Dropped by #Shutdown without running
+                    Failed    = 3  //!< The task threw
+                };
+
+                typedef struct {
+                    volatile uint32_t status_;  //!< Futex word, one of #Status
+                    volatile uint32_t waiters_;
+                } State;
+
+            protected: // data
+
+                std::shared_ptr<State> state_;
+
+            public: // methods
+
+                Completion ();
+                Completion (const std::shared_ptr<State>& a_state);
+
+                bool    Wait      (int64_t a_timeout_ms = -1) const;
+                Status  GetStatus () const;
+                bool    IsValid   () const;
+
+                static void Complete (State& a_state, Status a_status);
+
+            };
+
+        protected: // Data Type(s)
+
+            typedef struct Node {
+                Node*                                 next_;
+                Task                                  task_;
+                std::shared_ptr<Completion::State>    state_;
+            } Node;
+
+        protected: // data
+
+            Node*             head_;           //!< Most recent task first, producers push here
+            volatile uint32_t wake_sequence_;  //!< Futex word, bumped on every wake-up
+            volatile uint32_t sleeping_;       //!< Non zero while the worker is parked, or about to park
+            volatile uint32_t submitting_;     //!< #Submit calls past the #accepting_ check
+            volatile bool     accepting_;
+            volatile bool     drain_;          //!< Run, rather than cancel, the tasks left at shutdown
+
+        public: // methods
+
+            TaskWorker (const char* a_name, bool a_high_priority = false);
+            TaskWorker (const char* a_name, const Placement& a_placement);
+            virtual ~TaskWorker ();
+
+            Completion    Submit         (const Task& a_task);
+            void          Shutdown       (bool a_drain = true);
+
+            virtual void  WorkerFunction ();
+
+        protected:
+
+            void          Init           ();
+            virtual void  WakeUp         ();
+            void          Run            (Node* a_batch, bool a_cancel);
+
+        };
+
+    } // namespace posix
+} // namespace osal
+
+/**
+ * @return true if the handle refers to a submitted task
+ */
+inline bool osal::posix::TaskWorker::Completion::IsValid () const
+{
+    return nullptr != state_;
+}
+
+/**
+ * @return Current status of the task, Cancelled if the handle is not #IsValid
+ */
+inline osal::posix::TaskWorker::Completion::Status osal::posix::TaskWorker::Completion::GetStatus () const
+{
+    if ( nullptr == state_ ) {
+        return Cancelled;
+    }
+    return (Status) __atomic_load_n(&state_->status_, __ATOMIC_ACQUIRE);
+}
+
+#endif // #ifndef NRS_OSAL_POSIX_POSIX_TASK_WORKER_H
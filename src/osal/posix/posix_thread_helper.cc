@@ -26,6 +26,13 @@
 #include <signal.h>  // sigaddset
 #include <string.h>
 
+#if defined(__linux__)
+    #include <errno.h>
+    #include <stdio.h>            // fopen
+    #include <sys/resource.h>     // setpriority
+    #include <linux/mempolicy.h>  // MPOL_PREFERRED
+#endif
+
 const osal::posix::ThreadHelper::ThreadID osal::posix::ThreadHelper::k_invalid_thread_id_ = 0;
 
 osal::posix::ThreadHelper::ThreadID osal::posix::ThreadHelper::main_thread_id_            = osal::posix::ThreadHelper::k_invalid_thread_id_;
@@ -63,3 +70,105 @@ void osal::posix::ThreadHelper::SetThreadName (const std::string& a_name)
     pthread_setname_np(pthread_self(), a_name.c_str());
 #endif
 }
+
+#if defined(__linux__)
+
+/**
+ * @brief Static helper method to restrict the current thread to a set of CPUs.
+ *
+ * @param a_cpus CPU numbers, empty to allow every CPU.
+ */
+void osal::posix::ThreadHelper::SetAffinity (const std::set<int>& a_cpus)
+{
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if ( 0 == a_cpus.size() ) {
+        for ( int cpu = 0 ; cpu < CPU_SETSIZE ; ++cpu ) {
+            CPU_SET(cpu, &cpu_set);
+        }
+    } else {
+        for ( auto cpu : a_cpus ) {
+            CPU_SET(cpu, &cpu_set);
+        }
+    }
+    const int rv = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if ( 0 != rv ) {
+        throw OSAL_EXCEPTION("Unable to set thread affinity: %d - %s!", rv, strerror(rv));
+    }
+}
+
+/**
+ * @brief Static helper method to set the nice value of the current thread only.
+ *
+ * @param a_nice Nice value, negative values need CAP_SYS_NICE.
+ */
+void osal::posix::ThreadHelper::SetNice (int a_nice)
+{
+    if ( 0 != setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), a_nice) ) {
+        throw OSAL_EXCEPTION("Unable to set thread nice value: %d - %s!", errno, strerror(errno));
+    }
+}
+
+/**
+ * @brief Static helper method to allocate the current thread memory from a NUMA node.
+ *
+ *  Pages come from the node while it has free memory, from any other node after that.
+ *
+ * @param a_node NUMA node number.
+ */
+void osal::posix::ThreadHelper::PreferNumaNode (int a_node)
+{
+    unsigned long mask[16] = { 0 };
+    const unsigned long bits = sizeof(mask[0]) * 8;
+    if ( a_node < 0 || a_node >= (int) (sizeof(mask) * 8) ) {
+        throw OSAL_EXCEPTION("Unable to prefer NUMA node %d: out of range!", a_node);
+    }
+    mask[a_node / bits] |= ( 1UL << ( a_node % bits ) );
+    if ( 0 != syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, sizeof(mask) * 8 + 1) ) {
+        throw OSAL_EXCEPTION("Unable to prefer NUMA node %d: %d - %s!", a_node, errno, strerror(errno));
+    }
+}
+
+/**
+ * @brief Static helper method to read the CPUs of a NUMA node.
+ *
+ * @param a_node NUMA node number.
+ * @param o_cpus On success, the node CPU numbers are added to this set.
+ *
+ * @return False if the node does not exist.
+ */
+bool osal::posix::ThreadHelper::NumaNodeCPUs (int a_node, std::set<int>& o_cpus)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", a_node);
+    FILE* file = fopen(path, "r");
+    if ( nullptr == file ) {
+        return false;
+    }
+    // ... format is a comma separated list of ranges, e.g. 0-3,8-11 ...
+    int  first;
+    int  last;
+    bool found = false;
+    while ( 1 == fscanf(file, "%d", &first) ) {
+        last = first;
+        int separator = fgetc(file);
+        if ( '-' == separator ) {
+            if ( 1 != fscanf(file, "%d", &last) ) {
+                break;
+            }
+            separator = fgetc(file);
+        }
+        for ( int cpu = first ; cpu <= last ; ++cpu ) {
+            o_cpus.insert(cpu);
+            found = true;
+        }
+        if ( ',' != separator ) {
+            break;
+        }
+    }
+    fclose(file);
+    return found;
+}
+
+#endif // __linux__
+
@@ -66,6 +66,13 @@ namespace osal
             static void BlockSignals (const std::set<int>& a_signals);
                 
             static void SetThreadName (const std::string& a_name);
+
+#if defined(__linux__)
+            static void SetAffinity    (const std::set<int>& a_cpus);
+            static void SetNice        (int a_nice);
+            static void PreferNumaNode (int a_node);
+            static bool NumaNodeCPUs   (int a_node, std::set<int>& o_cpus);
+#endif
                 
         };
         
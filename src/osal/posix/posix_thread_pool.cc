@@ -0,0 +1,392 @@
+/**
+ * @file posix_thread_pool.cc - Work-stealing thread pool, implementation
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper-osal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "osal/posix/posix_thread_pool.h"
+#include "osal/posix/posix_thread_helper.h"
+#include "osal/posix/posix_futex.h"
+#include "osal/debug_trace.h"
+
+#include <unistd.h> // for sysconf
+
+__thread osal::posix::ThreadPool::Thread* osal::posix::ThreadPool::current_ = NULL;
+
+/*
+ * Deque, see "Correct and Efficient Work-Stealing for Weak Memory Models", Lê et al., PPoPP 2013
+ */
+
+osal::posix::ThreadPool::Deque::Deque ()
+{
+    top_    = 0;
+    bottom_ = 0;
+    array_  = NewArray(256);
+}
+
+osal::posix::ThreadPool::Deque::~Deque ()
+{
+    for ( int64_t i = top_; i < bottom_; ++i ) {
+        delete array_->slots_[i & (array_->capacity_ - 1)];
+    }
+    retired_.push_back(array_);
+    for ( auto array : retired_ ) {
+        delete [] array->slots_;
+        delete array;
+    }
+}
+
+osal::posix::ThreadPool::Deque::Array* osal::posix::ThreadPool::Deque::NewArray (int64_t a_capacity)
+{
+    Array* array     = new Array();
+    array->capacity_ = a_capacity;
+    array->slots_    = new Task*[a_capacity];
+    return array;
+}
+
+/**
+ * @brief Push a task at the bottom, owner only
+ */
+void osal::posix::ThreadPool::Deque::Push (Task* a_task)
+{
+    const int64_t bottom = __atomic_load_n(&bottom_, __ATOMIC_RELAXED);
+    const int64_t top    = __atomic_load_n(&top_, __ATOMIC_ACQUIRE);
+    Array*        array  = __atomic_load_n(&array_, __ATOMIC_RELAXED);
+
+    if ( bottom - top > array->capacity_ - 1 ) {
+        Array* grown = NewArray(array->capacity_ * 2);
+        for ( int64_t i = top; i < bottom; ++i ) {
+            grown->slots_[i & (grown->capacity_ - 1)] = __atomic_load_n(&array->slots_[i & (array->capacity_ - 1)], __ATOMIC_RELAXED);
+        }
+        retired_.push_back(array);
+        __atomic_store_n(&array_, grown, __ATOMIC_RELEASE);
+        array = grown;
+    }
+    __atomic_store_n(&array->slots_[bottom & (array->capacity_ - 1)], a_task, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&bottom_, bottom + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Pop the most recent task from the bottom, owner only
+ *
+ * @return The task or NULL if the deque is empty
+ */
+osal::posix::ThreadPool::Task* osal::posix::ThreadPool::Deque::Pop ()
+{
+    const int64_t bottom = __atomic_load_n(&bottom_, __ATOMIC_RELAXED) - 1;
+    Array*        array  = __atomic_load_n(&array_, __ATOMIC_RELAXED);
+    __atomic_store_n(&bottom_, bottom, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t top = __atomic_load_n(&top_, __ATOMIC_RELAXED);
+
+    Task* task = NULL;
+    if ( top <= bottom ) {
+        task = __atomic_load_n(&array->slots_[bottom & (array->capacity_ - 1)], __ATOMIC_RELAXED);
+        if ( top == bottom ) {
+            // ... last task, race the stealers for it ...
+            if ( false == __atomic_compare_exchange_n(&top_, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED) ) {
+                task = NULL;
+            }
+            __atomic_store_n(&bottom_, bottom + 1, __ATOMIC_RELAXED);
+        }
+    } else {
+        __atomic_store_n(&bottom_, bottom + 1, __ATOMIC_RELAXED);
+    }
+    return task;
+}
+
+/**
+ * @brief Steal the oldest task from the top, any thread
+ *
+ * @param o_retry Set to true when the steal lost a race, the deque may still have tasks
+ * @return The task or NULL
+ */
+osal::posix::ThreadPool::Task* osal::posix::ThreadPool::Deque::Steal (bool& o_retry)
+{
+    int64_t top = __atomic_load_n(&top_, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    const int64_t bottom = __atomic_load_n(&bottom_, __ATOMIC_ACQUIRE);
+
+    if ( top >= bottom ) {
+        return NULL;
+    }
+    Array* array = __atomic_load_n(&array_, __ATOMIC_ACQUIRE);
+    Task*  task  = __atomic_load_n(&array->slots_[top & (array->capacity_ - 1)], __ATOMIC_RELAXED);
+    if ( false == __atomic_compare_exchange_n(&top_, &top, top + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED) ) {
+        o_retry = true;
+        return NULL;
+    }
+    return task;
+}
+
+/**
+ * @return true if the deque looked empty, any thread
+ */
+bool osal::posix::ThreadPool::Deque::Empty () const
+{
+    return __atomic_load_n(&top_, __ATOMIC_ACQUIRE) >= __atomic_load_n(&bottom_, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * ThreadPool
+ */
+
+/**
+ * @brief Create a pool, the threads are only created by #Start
+ *
+ * @param a_name    Thread name prefix, each thread is named "<prefix>-<index>"
+ * @param a_threads Number of threads, 0 for one per online CPU
+ */
+osal::posix::ThreadPool::ThreadPool (const char* a_name, size_t a_threads)
+    : name_(a_name)
+{
+    injection_count_ = 0;
+    wake_sequence_   = 0;
+    sleepers_        = 0;
+    stop_            = false;
+    started_         = 0;
+    pthread_mutex_init(&injection_mutex_, NULL);
+
+    const size_t count = 0 != a_threads ? a_threads : HardwareConcurrency();
+    for ( size_t i = 0; i < count; ++i ) {
+        Thread* thread = new Thread();
+        thread->pool_   = this;
+        thread->index_  = i;
+        thread->random_ = 0x9E3779B97F4A7C15ull * (i + 1);
+        threads_.push_back(thread);
+    }
+}
+
+osal::posix::ThreadPool::~ThreadPool ()
+{
+    Shutdown();
+    for ( auto thread : threads_ ) {
+        delete thread;
+    }
+    for ( auto task : injection_ ) {
+        delete task;
+    }
+    pthread_mutex_destroy(&injection_mutex_);
+}
+
+/**
+ * @return Number of online CPUs, at least 1
+ */
+size_t osal::posix::ThreadPool::HardwareConcurrency ()
+{
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t) count : 1;
+}
+
+/**
+ * @brief Create the pool threads
+ *
+ * @return false if a thread could not be created, the threads already created are stopped
+ */
+bool osal::posix::ThreadPool::Start ()
+{
+    for ( size_t i = 0; i < threads_.size(); ++i ) {
+        if ( 0 != pthread_create(&threads_[i]->handle_, NULL, &ThreadPool::RunLoopWrapper, threads_[i]) ) {
+            Shutdown();
+            return false;
+        }
+        started_ += 1;
+    }
+    return true;
+}
+
+/**
+ * @brief Queue a task
+ *
+ *  From a pool thread the task goes to that thread deque, where it is popped last in first out
+ *  or stolen, otherwise it goes to the injection queue. Must not be called after #Shutdown.
+ *
+ * @param a_task Task to run on one of the pool threads
+ */
+void osal::posix::ThreadPool::Submit (const Task& a_task)
+{
+    Task* task = new Task(a_task);
+    if ( true == InPool() ) {
+        current_->deque_.Push(task);
+    } else {
+        pthread_mutex_lock(&injection_mutex_);
+        injection_.push_back(task);
+        __atomic_store_n(&injection_count_, injection_.size(), __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&injection_mutex_);
+    }
+    Notify();
+}
+
+/**
+ * @brief Wake one parked thread, if any
+ *
+ *  Pairs with #Park: the task is published before #sleepers_ is read here, a parking thread
+ *  publishes itself in #sleepers_ before it looks for work, so one of the two sees the other.
+ */
+void osal::posix::ThreadPool::Notify ()
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if ( 0 != __atomic_load_n(&sleepers_, __ATOMIC_RELAXED) ) {
+        __atomic_add_fetch(&wake_sequence_, 1, __ATOMIC_SEQ_CST);
+        Futex::Wake(&wake_sequence_, 1);
+    }
+}
+
+/**
+ * @return true if any deque or the injection queue looked non-empty
+ */
+bool osal::posix::ThreadPool::HasWork () const
+{
+    if ( 0 != __atomic_load_n(&injection_count_, __ATOMIC_ACQUIRE) ) {
+        return true;
+    }
+    for ( auto thread : threads_ ) {
+        if ( false == thread->deque_.Empty() ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Find the next task: own deque, then the injection queue, then random victims
+ *
+ * @param a_thread Calling pool thread
+ * @return The task or NULL if no work was found
+ */
+osal::posix::ThreadPool::Task* osal::posix::ThreadPool::NextTask (Thread* a_thread)
+{
+    Task* task = a_thread->deque_.Pop();
+    if ( NULL != task ) {
+        return task;
+    }
+
+    if ( 0 != __atomic_load_n(&injection_count_, __ATOMIC_ACQUIRE) ) {
+        pthread_mutex_lock(&injection_mutex_);
+        if ( false == injection_.empty() ) {
+            task = injection_.front();
+            injection_.pop_front();
+            __atomic_store_n(&injection_count_, injection_.size(), __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&injection_mutex_);
+        if ( NULL != task ) {
+            return task;
+        }
+    }
+
+    const size_t count = threads_.size();
+    bool         retry = true;
+    while ( true == retry ) {
+        retry = false;
+        // ... xorshift64, start at a random victim and sweep the others ...
+        a_thread->random_ ^= a_thread->random_ << 13;
+        a_thread->random_ ^= a_thread->random_ >> 7;
+        a_thread->random_ ^= a_thread->random_ << 17;
+        const size_t first = (size_t) (a_thread->random_ % count);
+        for ( size_t i = 0; i < count; ++i ) {
+            Thread* victim = threads_[(first + i) % count];
+            if ( victim == a_thread ) {
+                continue;
+            }
+            task = victim->deque_.Steal(retry);
+            if ( NULL != task ) {
+                return task;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Sleep until a task is submitted, or the pool is stopped
+ *
+ * @param a_thread Calling pool thread
+ */
+void osal::posix::ThreadPool::Park (Thread* a_thread)
+{
+    OSAL_UNUSED_PARAM(a_thread);
+    const uint32_t sequence = __atomic_load_n(&wake_sequence_, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&sleepers_, 1, __ATOMIC_SEQ_CST);
+    if ( false == HasWork() && false == __atomic_load_n(&stop_, __ATOMIC_SEQ_CST) ) {
+        DEBUGTRACE("ThreadPool", "== %s-%zu parking\n", name_.c_str(), a_thread->index_);
+        Futex::Wait(&wake_sequence_, sequence);
+    }
+    __atomic_sub_fetch(&sleepers_, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Pool thread loop, runs until the pool is stopped and no work is left
+ *
+ * @param a_thread Pool thread
+ */
+void osal::posix::ThreadPool::RunLoop (Thread* a_thread)
+{
+    current_ = a_thread;
+
+    std::string name = name_ + "-" + std::to_string(a_thread->index_);
+    if ( name.length() > 15 ) {
+        // ... pthread_setname_np limit, keep the index ...
+        name = name_.substr(0, 15 - ( name.length() - name_.length() )) + name.substr(name_.length());
+    }
+    ThreadHelper::SetThreadName(name);
+
+    for ( ;; ) {
+        Task* task = NextTask(a_thread);
+        if ( NULL != task ) {
+            (*task)();
+            delete task;
+            continue;
+        }
+        if ( true == __atomic_load_n(&stop_, __ATOMIC_ACQUIRE) && false == HasWork() ) {
+            break;
+        }
+        Park(a_thread);
+    }
+
+    current_ = NULL;
+}
+
+/**
+ * @brief Thread main function, just a static C wrapper to call #RunLoop()
+ *
+ * @param a_thread Pointer to the pool thread
+ */
+void* osal::posix::ThreadPool::RunLoopWrapper (void* a_thread)
+{
+    Thread* thread = (Thread*) a_thread;
+    thread->pool_->RunLoop(thread);
+    return NULL;
+}
+
+/**
+ * @brief Stop the pool, the queued tasks are run first, and join the threads
+ *
+ *  Must not be called from a pool thread.
+ */
+void osal::posix::ThreadPool::Shutdown ()
+{
+    if ( true == __atomic_exchange_n(&stop_, true, __ATOMIC_SEQ_CST) ) {
+        return;
+    }
+    __atomic_add_fetch(&wake_sequence_, 1, __ATOMIC_SEQ_CST);
+    Futex::Wake(&wake_sequence_);
+    for ( size_t i = 0; i < started_; ++i ) {
+        pthread_join(threads_[i]->handle_, NULL);
+    }
+}
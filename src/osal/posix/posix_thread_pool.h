@@ -0,0 +1,157 @@
+#pragma once
+/**
+ * @file posix_thread_pool.h - Work-stealing thread pool, declaration
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper-osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Each pool thread owns a Chase-Lev deque: it pushes and pops tasks at the bottom, other
+ * threads steal from the top. Tasks submitted from a pool thread go to its own deque, tasks
+ * submitted from any other thread go to a shared injection queue.
+ *
+ * A thread that finds no work in its deque, in the injection queue or in the deque of a
+ * random victim parks on a futex. Submit only enters the kernel when some thread is parked.
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_THREAD_POOL_H
+#define NRS_OSAL_POSIX_POSIX_THREAD_POOL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h> // for size_t
+
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace osal
+{
+    namespace posix
+    {
+        class ThreadPool
+        {
+
+        public: // Data Type(s)
+
+            typedef std::function<void()> Task;
+
+        protected: // Data Type(s)
+
+            /**
+             * @brief Chase-Lev work-stealing deque of task pointers.
+             */
+            class Deque
+            {
+
+            protected: // Data Type(s)
+
+                typedef struct {
+                    int64_t capacity_; //!< Power of two
+                    Task**  slots_;
+                } Array;
+
+            protected: // data
+
+                int64_t             top_;          //!< Stealers side
+                uint8_t             padding_[56];  //!< Keeps #top_ and #bottom_ apart, the pool threads are heap allocated
+                int64_t             bottom_;       //!< Owner side
+                Array*              array_;
+                std::vector<Array*> retired_;      //!< Grown out arrays, a stealer may still read them
+
+            public: // methods
+
+                Deque ();
+                virtual ~Deque ();
+
+                void   Push  (Task* a_task);
+                Task*  Pop   ();
+                Task*  Steal (bool& o_retry);
+                bool   Empty () const;
+
+            protected:
+
+                static Array* NewArray (int64_t a_capacity);
+
+            };
+
+            typedef struct {
+                ThreadPool* pool_;
+                size_t      index_;
+                pthread_t   handle_;
+                uint64_t    random_;   //!< xorshift state for victim selection
+                Deque       deque_;
+            } Thread;
+
+        protected: // data
+
+            const std::string    name_;
+            std::vector<Thread*> threads_;
+            pthread_mutex_t      injection_mutex_;
+            std::deque<Task*>    injection_;
+            volatile size_t      injection_count_; //!< Size of #injection_, read without the lock
+            volatile uint32_t    wake_sequence_;   //!< Futex word, bumped on every wake-up
+            volatile uint32_t    sleepers_;        //!< Threads parked, or about to park
+            volatile bool        stop_;
+            size_t               started_;         //!< Number of threads created by #Start
+
+            static __thread Thread* current_;      //!< Pool thread running on this thread, NULL elsewhere
+
+        public: // methods
+
+            ThreadPool (const char* a_name, size_t a_threads = 0);
+            virtual ~ThreadPool ();
+
+            bool    Start       ();
+            void    Submit      (const Task& a_task);
+            void    Shutdown    ();
+            size_t  Size        () const;
+            bool    InPool      () const;
+
+            static size_t HardwareConcurrency ();
+
+        protected:
+
+            Task*   NextTask     (Thread* a_thread);
+            void    Park         (Thread* a_thread);
+            void    Notify       ();
+            bool    HasWork      () const;
+            void    RunLoop      (Thread* a_thread);
+
+            static void* RunLoopWrapper (void* a_thread);
+
+        };
+
+    } // namespace posix
+} // namespace osal
+
+/**
+ * @return Number of threads in the pool
+ */
+inline size_t osal::posix::ThreadPool::Size () const
+{
+    return threads_.size();
+}
+
+/**
+ * @return true when called from one of this pool threads
+ */
+inline bool osal::posix::ThreadPool::InPool () const
+{
+    return NULL != current_ && this == current_->pool_;
+}
+
+#endif // #ifndef NRS_OSAL_POSIX_POSIX_THREAD_POOL_H
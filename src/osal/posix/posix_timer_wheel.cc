@@ -0,0 +1,378 @@
+/**
+ * @file posix_timer_wheel.cc - Hierarchical timer wheel for delayed and periodic tasks, implementation
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper-osal.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "osal/posix/posix_timer_wheel.h"
+#include "osal/posix/posix_thread_helper.h"
+#include "osal/posix/posix_futex.h"
+
+#include <time.h> // for clock_gettime
+
+/**
+ * @brief Create a wheel, its thread is only created by #Start
+ *
+ * @param a_name       Name of the wheel thread
+ * @param a_dispatcher Called with each expired task, empty to run them on the wheel thread
+ */
+osal::posix::TimerWheel::TimerWheel (const char* a_name, const Dispatcher& a_dispatcher)
+    : name_(a_name), dispatcher_(a_dispatcher)
+{
+    free_          = -1;
+    base_          = 0;
+    next_wake_     = 0;
+    count_         = 0;
+    wake_sequence_ = 0;
+    stop_          = false;
+    started_       = false;
+    for ( int i = 0; i < k_slots_; ++i ) {
+        slots_[i] = -1;
+    }
+    pthread_mutex_init(&mutex_, NULL);
+    epoch_ms_ = 0;
+    epoch_ms_ = Now();
+}
+
+osal::posix::TimerWheel::~TimerWheel ()
+{
+    Shutdown();
+    pthread_mutex_destroy(&mutex_);
+}
+
+/**
+ * @brief Create the wheel thread
+ *
+ * @return false if the thread could not be created
+ */
+bool osal::posix::TimerWheel::Start ()
+{
+    if ( 0 != pthread_create(&thread_, NULL, &TimerWheel::RunLoopWrapper, this) ) {
+        return false;
+    }
+    started_ = true;
+    return true;
+}
+
+/**
+ * @brief Stop the wheel thread and wait for it, pending timers are dropped without running
+ */
+void osal::posix::TimerWheel::Shutdown ()
+{
+    if ( true == __atomic_exchange_n(&stop_, true, __ATOMIC_SEQ_CST) ) {
+        return;
+    }
+    __atomic_add_fetch(&wake_sequence_, 1, __ATOMIC_SEQ_CST);
+    Futex::Wake(&wake_sequence_);
+    if ( true == started_ ) {
+        pthread_join(thread_, NULL);
+    }
+}
+
+/**
+ * @brief Arm a timer
+ *
+ *  The timer never fires early, it fires up to one tick late plus the wheel thread wake-up latency.
+ *
+ * @param a_delay_ms  Milliseconds until the first firing, 0 for the next tick
+ * @param a_task      Task to run, or to dispatch, when the timer fires
+ * @param a_period_ms Milliseconds between firings, 0 for a one shot timer
+ *
+ * @return Id to cancel the timer with
+ */
+osal::posix::TimerWheel::TimerId osal::posix::TimerWheel::Schedule (uint64_t a_delay_ms, const Task& a_task, uint64_t a_period_ms)
+{
+    pthread_mutex_lock(&mutex_);
+
+    int32_t index = free_;
+    if ( -1 != index ) {
+        free_ = timers_[index].next_;
+    } else {
+        index = (int32_t) timers_.size();
+        timers_.push_back(Timer());
+        timers_[index].generation_ = 1;
+    }
+    Timer& timer = timers_[index];
+    // ... Now() is rounded down, one more tick keeps the timer from firing early ...
+    timer.deadline_ = Now() + a_delay_ms + ( 0 != a_delay_ms ? 1 : 0 );
+    timer.period_   = a_period_ms;
+    timer.task_     = a_task;
+    File(index);
+
+    const TimerId id   = ( (TimerId) timer.generation_ << 32 ) | (uint32_t) index;
+    const bool    wake = timer.deadline_ < next_wake_;
+    if ( true == wake ) {
+        next_wake_ = timer.deadline_;
+    }
+
+    pthread_mutex_unlock(&mutex_);
+
+    // ... the wheel thread sleeps past the new deadline ...
+    if ( true == wake ) {
+        __atomic_add_fetch(&wake_sequence_, 1, __ATOMIC_SEQ_CST);
+        Futex::Wake(&wake_sequence_, 1);
+    }
+    return id;
+}
+
+/**
+ * @brief Disarm a timer
+ *
+ *  A periodic timer may still fire once if it was already handed to the dispatcher.
+ *
+ * @param a_id Id returned by #Schedule
+ *
+ * @return false if the timer already fired, was cancelled or never existed
+ */
+bool osal::posix::TimerWheel::Cancel (TimerId a_id)
+{
+    const int32_t  index      = (int32_t) ( a_id & 0xFFFFFFFF );
+    const uint32_t generation = (uint32_t) ( a_id >> 32 );
+
+    bool rv = false;
+    pthread_mutex_lock(&mutex_);
+    if ( index >= 0 && index < (int32_t) timers_.size() && generation == timers_[index].generation_ && -1 != timers_[index].slot_ ) {
+        Unfile(index);
+        Release(index);
+        rv = true;
+    }
+    pthread_mutex_unlock(&mutex_);
+    return rv;
+}
+
+/**
+ * @return Number of armed timers
+ */
+size_t osal::posix::TimerWheel::Count ()
+{
+    pthread_mutex_lock(&mutex_);
+    const size_t count = count_;
+    pthread_mutex_unlock(&mutex_);
+    return count;
+}
+
+/**
+ * @return Milliseconds since the wheel was created
+ */
+uint64_t osal::posix::TimerWheel::Now () const
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000 - epoch_ms_;
+}
+
+/**
+ * @brief File a timer in the slot of its deadline, must be called with #mutex_ held
+ *
+ * @param a_index Timer record
+ */
+void osal::posix::TimerWheel::File (int32_t a_index)
+{
+    Timer& timer = timers_[a_index];
+
+    // ... a deadline already past goes to the next tick to process ...
+    uint64_t       expires = timer.deadline_ > base_ ? timer.deadline_ : base_;
+    const uint64_t delta   = expires - base_;
+
+    int32_t slot;
+    if ( delta < ( 1ull << k_level_0_bits_ ) ) {
+        slot = (int32_t) ( expires & ( ( 1 << k_level_0_bits_ ) - 1 ) );
+    } else {
+        int level = 1;
+        while ( level < k_levels_ - 1 && delta >= ( 1ull << ( k_level_0_bits_ + level * k_level_n_bits_ ) ) ) {
+            level += 1;
+        }
+        const int shift = k_level_0_bits_ + ( level - 1 ) * k_level_n_bits_;
+        if ( delta >= ( 1ull << ( shift + k_level_n_bits_ ) ) ) {
+            // ... beyond the last level, re-filed each time the last level cascades ...
+            expires = base_ + ( 1ull << ( shift + k_level_n_bits_ ) ) - 1;
+        }
+        slot = ( 1 << k_level_0_bits_ ) + ( level - 1 ) * ( 1 << k_level_n_bits_ )
+             + (int32_t) ( ( expires >> shift ) & ( ( 1 << k_level_n_bits_ ) - 1 ) );
+    }
+
+    timer.slot_ = slot;
+    timer.prev_ = -1;
+    timer.next_ = slots_[slot];
+    if ( -1 != timer.next_ ) {
+        timers_[timer.next_].prev_ = a_index;
+    }
+    slots_[slot] = a_index;
+    count_ += 1;
+}
+
+/**
+ * @brief Take a timer out of its slot, must be called with #mutex_ held
+ *
+ * @param a_index Timer record
+ */
+void osal::posix::TimerWheel::Unfile (int32_t a_index)
+{
+    Timer& timer = timers_[a_index];
+    if ( -1 != timer.prev_ ) {
+        timers_[timer.prev_].next_ = timer.next_;
+    } else {
+        slots_[timer.slot_] = timer.next_;
+    }
+    if ( -1 != timer.next_ ) {
+        timers_[timer.next_].prev_ = timer.prev_;
+    }
+    timer.slot_ = -1;
+    count_ -= 1;
+}
+
+/**
+ * @brief Return an unfiled timer record to the free list, must be called with #mutex_ held
+ *
+ * @param a_index Timer record
+ */
+void osal::posix::TimerWheel::Release (int32_t a_index)
+{
+    Timer& timer = timers_[a_index];
+    timer.task_        = nullptr;
+    timer.generation_ += 1;
+    if ( 0 == timer.generation_ ) {
+        timer.generation_ = 1; // ... keeps every id different from k_invalid_timer_ ...
+    }
+    timer.next_ = free_;
+    free_       = a_index;
+}
+
+/**
+ * @brief Re-file every timer of an upper level slot, they land on lower levels
+ *
+ * @param a_level Level, 1 to k_levels_ - 1
+ * @param a_slot  Slot within the level
+ */
+void osal::posix::TimerWheel::Cascade (int a_level, int32_t a_slot)
+{
+    const int32_t slot  = ( 1 << k_level_0_bits_ ) + ( a_level - 1 ) * ( 1 << k_level_n_bits_ ) + a_slot;
+    int32_t       index = slots_[slot];
+    slots_[slot] = -1;
+    while ( -1 != index ) {
+        const int32_t next = timers_[index].next_;
+        count_ -= 1;
+        File(index);
+        index = next;
+    }
+}
+
+/**
+ * @brief Process every tick up to, and including, a_now, must be called with #mutex_ held
+ *
+ * @param a_now      Current tick
+ * @param o_expired  The tasks of the timers that fired are appended here
+ */
+void osal::posix::TimerWheel::Advance (uint64_t a_now, std::vector<Task>& o_expired)
+{
+    while ( base_ <= a_now ) {
+        const int32_t index = (int32_t) ( base_ & ( ( 1 << k_level_0_bits_ ) - 1 ) );
+        if ( 0 == index ) {
+            for ( int level = 1; level < k_levels_; ++level ) {
+                const int32_t slot = (int32_t) ( ( base_ >> ( k_level_0_bits_ + ( level - 1 ) * k_level_n_bits_ ) ) & ( ( 1 << k_level_n_bits_ ) - 1 ) );
+                Cascade(level, slot);
+                if ( 0 != slot ) {
+                    break;
+                }
+            }
+        }
+
+        int32_t timer_index = slots_[index];
+        while ( -1 != timer_index ) {
+            Timer&        timer = timers_[timer_index];
+            const int32_t next  = timer.next_;
+            Unfile(timer_index);
+
+            if ( 0 != timer.period_ ) {
+                o_expired.push_back(timer.task_);
+                // ... from the deadline, not from now, so the period does not drift ...
+                timer.deadline_ += timer.period_;
+                if ( timer.deadline_ <= base_ ) {
+                    timer.deadline_ = base_ + 1; // ... overrun, skip the missed firings ...
+                }
+                File(timer_index);
+            } else {
+                o_expired.push_back(Task());
+                o_expired.back().swap(timer.task_);
+                Release(timer_index);
+            }
+            timer_index = next;
+        }
+        base_ += 1;
+    }
+}
+
+/**
+ * @return The next tick with work, a due level 0 slot or the next cascade
+ */
+uint64_t osal::posix::TimerWheel::NextTick () const
+{
+    const uint64_t boundary = ( base_ | ( ( 1 << k_level_0_bits_ ) - 1 ) ) + 1;
+    for ( uint64_t tick = base_; tick < boundary; ++tick ) {
+        if ( -1 != slots_[tick & ( ( 1 << k_level_0_bits_ ) - 1 )] ) {
+            return tick;
+        }
+    }
+    return boundary;
+}
+
+/**
+ * @brief The wheel thread, advances the wheel and sleeps until the next tick with work
+ */
+void osal::posix::TimerWheel::RunLoop ()
+{
+    osal::posix::ThreadHelper::SetThreadName(name_);
+
+    std::vector<Task> expired;
+    while ( false == __atomic_load_n(&stop_, __ATOMIC_SEQ_CST) ) {
+        pthread_mutex_lock(&mutex_);
+        Advance(Now(), expired);
+        next_wake_ = NextTick();
+        const uint64_t next     = next_wake_;
+        const uint32_t sequence = __atomic_load_n(&wake_sequence_, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&mutex_);
+
+        for ( auto& task : expired ) {
+            if ( dispatcher_ ) {
+                dispatcher_(task);
+            } else {
+                task();
+            }
+        }
+        expired.clear();
+
+        const uint64_t now = Now();
+        if ( now < next ) {
+            struct timespec timeout;
+            timeout.tv_sec  = (time_t) ( ( next - now ) / 1000 );
+            timeout.tv_nsec = (long) ( ( next - now ) % 1000 ) * 1000000;
+            Futex::Wait(&wake_sequence_, sequence, &timeout);
+        }
+    }
+}
+
+/**
+ * @brief Thread entry point, calls #RunLoop
+ *
+ * @param a_self The wheel
+ */
+void* osal::posix::TimerWheel::RunLoopWrapper (void* a_self)
+{
+    ((TimerWheel*) a_self)->RunLoop();
+    return NULL;
+}
@@ -0,0 +1,142 @@
+#pragma once
+/**
+ * @file posix_timer_wheel.h - Hierarchical timer wheel for delayed and periodic tasks, declaration
+ *
+ * Copyright (c) 2011-2018 Cloudware S.A. All rights reserved.
+ *
+ * This file is part of casper-osal.
+ *
+ * casper-osal is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * casper-osal is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with casper-osal.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * One millisecond ticks over four levels: 256 slots of 1 ms, then 64 slots each of 256 ms,
+ * 16 s and 17 min, about 18 hours in all. Timers further away wait in the last level and are
+ * re-filed each time it cascades. Adding and cancelling a timer is O(1), each timer cascades
+ * at most three times before it fires.
+ *
+ * The wheel thread only wakes for a due slot or a cascade, not on every tick. Expired tasks run
+ * on the wheel thread, or are handed to a dispatcher, e.g. a TaskWorker or a ThreadPool:
+ *
+ *     osal::posix::TimerWheel wheel("timers", osal::posix::TimerWheel::DispatchTo(pool));
+ */
+#ifndef NRS_OSAL_POSIX_POSIX_TIMER_WHEEL_H
+#define NRS_OSAL_POSIX_POSIX_TIMER_WHEEL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stddef.h> // for size_t
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace osal
+{
+    namespace posix
+    {
+        class TimerWheel
+        {
+
+        public: // Data Type(s)
+
+            typedef std::function<void()>             Task;
+            typedef std::function<void(const Task&)>  Dispatcher;
+            typedef uint64_t                          TimerId;
+
+        public: // Static Const
+
+            static const TimerId k_invalid_timer_ = 0;
+
+        protected: // Data Type(s)
+
+            typedef struct {
+                uint64_t deadline_;   //!< Tick the timer fires at
+                uint64_t period_;     //!< Ticks between firings, 0 for a one shot timer
+                uint32_t generation_; //!< Bumped when the record is freed, stale ids no longer match
+                int32_t  next_;       //!< Next timer in the slot, or in the free list
+                int32_t  prev_;       //!< Previous timer in the slot, -1 for the first
+                int32_t  slot_;       //!< Slot the timer is filed in, -1 while not filed
+                Task     task_;
+            } Timer;
+
+        protected: // Const
+
+            static const int k_level_0_bits_ = 8;
+            static const int k_level_n_bits_ = 6;
+            static const int k_levels_       = 4;
+            static const int k_slots_        = ( 1 << k_level_0_bits_ ) + ( k_levels_ - 1 ) * ( 1 << k_level_n_bits_ );
+
+        protected: // data
+
+            const std::string    name_;
+            const Dispatcher     dispatcher_;
+            pthread_mutex_t      mutex_;           //!< Guards everything below but the futex words
+            std::vector<Timer>   timers_;
+            int32_t              free_;            //!< First free record in #timers_, -1 for none
+            int32_t              slots_[k_slots_]; //!< First timer of each slot, -1 for empty
+            uint64_t             base_;            //!< Next tick to process
+            uint64_t             next_wake_;       //!< Tick the wheel thread sleeps until
+            size_t               count_;           //!< Timers filed
+            uint64_t             epoch_ms_;        //!< Monotonic clock at tick 0
+            volatile uint32_t    wake_sequence_;   //!< Futex word, bumped on every wake-up
+            volatile bool        stop_;
+            bool                 started_;
+            pthread_t            thread_;
+
+        public: // methods
+
+            TimerWheel (const char* a_name, const Dispatcher& a_dispatcher = Dispatcher());
+            virtual ~TimerWheel ();
+
+            bool     Start    ();
+            void     Shutdown ();
+            TimerId  Schedule (uint64_t a_delay_ms, const Task& a_task, uint64_t a_period_ms = 0);
+            bool     Cancel   (TimerId a_id);
+            size_t   Count    ();
+
+            template <class Executor>
+            static Dispatcher DispatchTo (Executor& a_executor);
+
+        protected:
+
+            uint64_t Now      () const;
+            void     File     (int32_t a_index);
+            void     Unfile   (int32_t a_index);
+            void     Release  (int32_t a_index);
+            void     Cascade  (int a_level, int32_t a_slot);
+            void     Advance  (uint64_t a_now, std::vector<Task>& o_expired);
+            uint64_t NextTick () const;
+            void     RunLoop  ();
+
+            static void* RunLoopWrapper (void* a_self);
+
+        };
+
+    } // namespace posix
+} // namespace osal
+
+/**
+ * @brief Build a dispatcher that submits expired tasks to an executor
+ *
+ * @param a_executor Anything with a Submit(std::function<void()>), must outlive the wheel
+ */
+template <class Executor>
+inline osal::posix::TimerWheel::Dispatcher osal::posix::TimerWheel::DispatchTo (Executor& a_executor)
+{
+    Executor* executor = &a_executor;
+    return [executor] (const Task& a_task) {
+        executor->Submit(a_task);
+    };
+}
+
+#endif // #ifndef NRS_OSAL_POSIX_POSIX_TIMER_WHEEL_H
@@ -22,10 +22,13 @@
  */
 
 #include "osal/posix/posix_worker.h"
+#include "osal/posix/posix_thread_helper.h"
 #include "osal/debug_trace.h"
 
 #include "osal/osal_types.h"
 
+#include <errno.h>
+
 #ifdef ANDROID
 #include <jni.h>
 extern JavaVM* g_java_vm_; // Pointer to the process wide JavaVM from streamer_jni.cc
@@ -36,29 +39,55 @@ extern JavaVM* g_java_vm_; // Pointer to the process wide JavaVM from streamer_j
 
 osal::posix::Worker::Worker (const char* a_name, bool a_high_priority)
 {
-    name_        = a_name;
-    startup_err_ = 0;
+    name_ = a_name;
+    Create(a_high_priority);
+}
+
+/**
+ * @brief Create a worker with its thread pinned and scheduled as requested
+ *
+ * @param a_name      Name of the thread
+ * @param a_placement CPUs, NUMA node and scheduling of the thread, see #Placement
+ */
+osal::posix::Worker::Worker (const char* a_name, const Placement& a_placement)
+{
+    name_      = a_name;
+    placement_ = a_placement;
+    Create(false);
+}
+
+/**
+ * @brief Create the mutex, condition and thread, shared by the constructors
+ *
+ * @param a_high_priority Raise the thread priority, iOS only
+ */
+void osal::posix::Worker::Create (bool a_high_priority)
+{
+    startup_err_   = 0;
+    placement_err_ = 0;
     pthread_mutexattr_t mutexAttr;
 
     running_    = false;   // Assume idle until the thread is effectively created
     run_worker_ = false;   //
+    joined_     = true;    // Nothing to join until the thread is created
 
     /*
      * Create run mutexes and conditions, worker will sleep in the condition
      */
     startup_err_ += pthread_mutexattr_init(&mutexAttr);
+#if defined(OSAL_MUTEX_ERRORCHECK)
     startup_err_ += pthread_mutexattr_settype(&mutexAttr, PTHREAD_MUTEX_ERRORCHECK);
+#endif
     startup_err_ += pthread_mutex_init(&run_mutex_, &mutexAttr);
     startup_err_ += pthread_mutexattr_destroy(&mutexAttr);
     startup_err_ += pthread_cond_init(&run_condition_, NULL);
 
-#if defined(TARGET_OS_IPHONE) || defined(TARGET_IPHONE_SIMULATOR)
-
     pthread_attr_t attr;
+    startup_err_ += pthread_attr_init(&attr);
 
-    if ( a_high_priority == true ) {
+#if defined(TARGET_OS_IPHONE) || defined(TARGET_IPHONE_SIMULATOR)
 
-        pthread_attr_init(&attr);
+    if ( a_high_priority == true ) {
 
         int policy = 0;
 
@@ -74,25 +103,131 @@ osal::posix::Worker::Worker (const char* a_name, bool a_high_priority)
     }
 #endif
 
+    if ( startup_err_ == 0 ) {
+        startup_err_ += PlaceThreadAttr(&attr);
+    }
+
     if ( startup_err_ == 0 ) {
         /*
          * Set running_ true *before* creating the thread
          */
-        running_ = true;
-        startup_err_ += pthread_create(&thread_handle_, NULL, &Worker::WorkerRunLoopWrapper, this);
-        startup_err_ += pthread_detach(thread_handle_);
+        running_       = true;
+        placement_err_ = -1;   // ... until the thread reports, see PlacementError() ...
+        startup_err_ += pthread_create(&thread_handle_, &attr, &Worker::WorkerRunLoopWrapper, this);
         if ( startup_err_ != 0 ) {
-            running_ = false; // in case things went wrong
+            running_       = false; // in case things went wrong
+            placement_err_ = 0;
+        } else {
+            joined_  = false; // ... joined by Shutdown, no longer detached ...
         }
     }
 
-#if defined(TARGET_OS_IPHONE) || defined(TARGET_IPHONE_SIMULATOR)
-    if ( a_high_priority == true ) {
-        pthread_attr_destroy(&attr);
+    pthread_attr_destroy(&attr);
+
+    OSAL_UNUSED_PARAM(a_high_priority);
+}
+
+/**
+ * @brief Apply the CPUs and the scheduling policy of #placement_ to the thread attributes
+ *
+ * @param a_attr Attributes the thread is about to be created with
+ * @return 0 on success, an error number otherwise
+ */
+int osal::posix::Worker::PlaceThreadAttr (pthread_attr_t* a_attr)
+{
+#if defined(__linux__)
+    int rv = 0;
+
+    std::set<int> cpus;
+    if ( placement_.numa_node_ >= 0 ) {
+        std::set<int> node_cpus;
+        if ( false == osal::posix::ThreadHelper::NumaNodeCPUs(placement_.numa_node_, node_cpus) ) {
+            return ENOENT;
+        }
+        for ( auto cpu : node_cpus ) {
+            if ( 0 == placement_.cpus_.size() || 0 != placement_.cpus_.count(cpu) ) {
+                cpus.insert(cpu);
+            }
+        }
+        if ( 0 == cpus.size() ) {
+            return EINVAL; // ... none of the requested CPUs belongs to the node ...
+        }
+    } else {
+        cpus = placement_.cpus_;
     }
+
+    if ( 0 != cpus.size() ) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        for ( auto cpu : cpus ) {
+            if ( cpu < 0 || cpu >= CPU_SETSIZE ) {
+                return EINVAL;
+            }
+            CPU_SET(cpu, &cpu_set);
+        }
+        rv += pthread_attr_setaffinity_np(a_attr, sizeof(cpu_set), &cpu_set);
+    }
+
+    if ( SCHED_FIFO == placement_.policy_ || SCHED_RR == placement_.policy_ ) {
+        // ... pthread_create fails with EPERM without CAP_SYS_NICE or RLIMIT_RTPRIO ...
+        struct sched_param sched_param;
+        sched_param.sched_priority = placement_.priority_;
+        rv += pthread_attr_setinheritsched(a_attr, PTHREAD_EXPLICIT_SCHED);
+        rv += pthread_attr_setschedpolicy(a_attr, placement_.policy_);
+        rv += pthread_attr_setschedparam(a_attr, &sched_param);
+    }
+
+    return rv;
+#else
+    OSAL_UNUSED_PARAM(a_attr);
+    return 0;
 #endif
+}
 
-    OSAL_UNUSED_PARAM(a_high_priority);
+/**
+ * @brief Apply, from the worker thread, the parts of #placement_ that are per thread state
+ *
+ *  The outcome is published under the run lock, see #PlacementError.
+ */
+void osal::posix::Worker::PlaceThread ()
+{
+    int err = 0;
+#if defined(__linux__)
+    try {
+        if ( placement_.numa_node_ >= 0 ) {
+            osal::posix::ThreadHelper::PreferNumaNode(placement_.numa_node_);
+        }
+        if ( 0 != placement_.nice_ && SCHED_FIFO != placement_.policy_ && SCHED_RR != placement_.policy_ ) {
+            osal::posix::ThreadHelper::SetNice(placement_.nice_);
+        }
+    } catch (const osal::Exception& a_exception) {
+        DEBUGTRACE("Worker", "== worker %s placement failed: %s\n", name_, a_exception.Message());
+        err = 1;
+    }
+#endif
+    LockRun();
+    placement_err_ = err;
+    UnlockRun();
+    WakeRun();
+}
+
+/**
+ * @brief Tell whether the worker thread applied the nice value and NUMA node of its #Placement
+ *
+ *  Waits for the thread to get that far, it does so before running any #WorkerFunction. The
+ *  CPUs and the scheduling policy are applied at creation, a failure there is a startup error.
+ *
+ * @return 0 on success, or when the thread was never created, non-zero otherwise
+ */
+int osal::posix::Worker::PlacementError ()
+{
+    LockRun();
+    while ( -1 == placement_err_ ) {
+        WaitRun();
+    }
+    const int err = placement_err_;
+    UnlockRun();
+    return err;
 }
 
 /**
@@ -101,10 +236,10 @@ osal::posix::Worker::Worker (const char* a_name, bool a_high_priority)
  */
 void osal::posix::Worker::StartWorkerThread ()
 {
-    pthread_mutex_lock(&run_mutex_);
+    LockRun();
     run_worker_ = true;
-    pthread_mutex_unlock(&run_mutex_);
-    pthread_cond_broadcast(&run_condition_);
+    UnlockRun();
+    WakeRun();
 }
 
 /**
@@ -112,11 +247,11 @@ void osal::posix::Worker::StartWorkerThread ()
  */
 void osal::posix::Worker::Abort ()
 {
-    pthread_mutex_lock(&run_mutex_);
+    LockRun();
     while (run_worker_ == true) {
-        pthread_cond_wait(&run_condition_, &run_mutex_);
+        WaitRun();
     }
-    pthread_mutex_unlock(&run_mutex_);
+    UnlockRun();
 }
 
 /**
@@ -126,26 +261,28 @@ void osal::posix::Worker::Abort ()
  */
 int osal::posix::Worker::WorkerRunLoop ()
 {
-#ifdef __APPLE__
-    pthread_setname_np(name_);
-#else
-    pthread_setname_np(pthread_self(), name_);
-#endif
+    osal::posix::ThreadHelper::SetThreadName(name_);
 
     while ( running_ == true ) {
         DEBUGTRACE("Worker", "== worker sleeping\n");
-        pthread_mutex_lock(&run_mutex_);
-        while (run_worker_ == false) {
-            pthread_cond_wait(&run_condition_, &run_mutex_);
+        LockRun();
+        while (run_worker_ == false && running_ == true) {
+            WaitRun();
+        }
+        if ( running_ == false ) {
+            run_worker_ = false; // ... dropped, release any Abort() waiter ...
+            UnlockRun();
+            WakeRun();
+            break;
         }
-        pthread_mutex_unlock(&run_mutex_);
+        UnlockRun();
 
         WorkerFunction();
 
-        pthread_mutex_lock(&run_mutex_);
+        LockRun();
         run_worker_ = false;
-        pthread_mutex_unlock(&run_mutex_);
-        pthread_cond_broadcast(&run_condition_);
+        UnlockRun();
+        WakeRun();
     }
 
     detach_thread_from_java();
@@ -161,12 +298,91 @@ int osal::posix::Worker::WorkerRunLoop ()
  */
 void* osal::posix::Worker::WorkerRunLoopWrapper (void* a_self)
 {
+    ((Worker*) a_self)->PlaceThread();
 	return (void*) (intptr_t)((Worker*) a_self)->WorkerRunLoop();
 }
 
+/**
+ * @brief Stop the worker thread and wait for it to exit
+ *
+ *  A #WorkerFunction in progress runs to the end, a pending #StartWorkerThread is dropped.
+ *  Subclasses must call this from their own destructor, the thread may still be calling
+ *  their #WorkerFunction otherwise. Must not be called from the worker thread.
+ */
+void osal::posix::Worker::Shutdown ()
+{
+    LockRun();
+    if ( joined_ == true ) {
+        UnlockRun();
+        return;
+    }
+    joined_  = true;
+    __atomic_store_n(&running_, false, __ATOMIC_SEQ_CST);
+    UnlockRun();
+    WakeRun();
+    WakeUp();
+    pthread_join(thread_handle_, NULL);
+}
+
+/**
+ * @brief Hook for subclasses that park their thread on something other than the run condition
+ */
+void osal::posix::Worker::WakeUp ()
+{
+    // EMPTY
+}
+
+/**
+ * @brief Acquire the run state lock, a pthread mutex in OSAL_MUTEX_PTHREAD builds
+ */
+void osal::posix::Worker::LockRun ()
+{
+#if defined(OSAL_MUTEX_PTHREAD)
+    pthread_mutex_lock(&run_mutex_);
+#else
+    run_spin_.Lock();
+#endif
+}
+
+/**
+ * @brief Release the run state lock
+ */
+void osal::posix::Worker::UnlockRun ()
+{
+#if defined(OSAL_MUTEX_PTHREAD)
+    pthread_mutex_unlock(&run_mutex_);
+#else
+    run_spin_.Unlock();
+#endif
+}
+
+/**
+ * @brief Wait for a run state change, the run state lock must be held
+ */
+void osal::posix::Worker::WaitRun ()
+{
+#if defined(OSAL_MUTEX_PTHREAD)
+    pthread_cond_wait(&run_condition_, &run_mutex_);
+#else
+    run_spin_cond_.Wait(run_spin_);
+#endif
+}
+
+/**
+ * @brief Wake every thread waiting for a run state change
+ */
+void osal::posix::Worker::WakeRun ()
+{
+#if defined(OSAL_MUTEX_PTHREAD)
+    pthread_cond_broadcast(&run_condition_);
+#else
+    run_spin_cond_.Broadcast();
+#endif
+}
+
 osal::posix::Worker::~Worker ()
 {
-    // TODO wait for thread exit
+    Shutdown();
 
     // Safety checks before destruction
     pthread_cond_destroy(&run_condition_);
@@ -24,8 +24,13 @@
 #ifndef NRS_OSAL_POSIX_POSIX_WORKER_H
 #define NRS_OSAL_POSIX_POSIX_WORKER_H
 
+#include "osal/posix/posix_spin_mutex.h"
+
 #include <stdio.h>
 #include <pthread.h>
+#include <sched.h> // for SCHED_OTHER
+
+#include <set>
 
 namespace osal
 {
@@ -33,27 +38,65 @@ namespace osal
     {
         class Worker
         {
+
+        public: // Data Type(s)
+
+            /**
+             * @brief Where and how the worker thread runs, honoured on Linux only.
+             *
+             *  The CPUs and the scheduling policy are set before the thread is created, so its
+             *  stack is first touched on the right CPUs. A #numa_node_ restricts the thread to the
+             *  node CPUs, or to the intersection with #cpus_, and prefers the node for its memory.
+             */
+            typedef struct Placement {
+                std::set<int> cpus_;      //!< CPUs the thread may run on, empty for any
+                int           numa_node_; //!< Node to run on and allocate from, -1 for any
+                int           policy_;    //!< SCHED_OTHER, SCHED_FIFO or SCHED_RR
+                int           priority_;  //!< Static priority for SCHED_FIFO and SCHED_RR
+                int           nice_;      //!< Nice value for SCHED_OTHER
+                Placement () : numa_node_(-1), policy_(SCHED_OTHER), priority_(0), nice_(0) {}
+            } Placement;
+
         protected:
 
             const char*     name_;           //!< Name of the thread
             pthread_t       thread_handle_;  //!< Posix Thread handle
-            pthread_mutex_t run_mutex_;      //!< Mutex to project access to state variable
-            pthread_cond_t  run_condition_;  //!< Condition var used to signal changes in thread state
+            pthread_mutex_t run_mutex_;      //!< Mutex to project access to state variable, OSAL_MUTEX_PTHREAD builds
+            pthread_cond_t  run_condition_;  //!< Condition var used to signal changes in thread state, OSAL_MUTEX_PTHREAD builds
+            SpinMutex       run_spin_;       //!< Replaces #run_mutex_ in the other builds
+            SpinCondition   run_spin_cond_;  //!< Replaces #run_condition_ in the other builds
             bool            running_;        //!< True while the worker is running
             bool            run_worker_;
             int             startup_err_;    //!< It will be non-zero if the constructor fails
+            bool            joined_;         //!< True once #Shutdown joined the thread
+            Placement       placement_;
+            int             placement_err_;  //!< -1 until the thread applied #placement_, then non-zero if it could not apply its nice value or NUMA node
 
         public: // methods
 
             Worker (const char* a_name, bool a_high_priority = false);
+            Worker (const char* a_name, const Placement& a_placement);
             virtual ~Worker ();
 
             virtual int   WorkerRunLoop        ();
             void          StartWorkerThread    ();
             void          Abort                ();
+            void          Shutdown             ();
+            int           PlacementError       ();
             virtual void  WorkerFunction       () = 0;
             static  void* WorkerRunLoopWrapper (void* a_self);
 
+        protected:
+
+            void          Create               (bool a_high_priority);
+            void          LockRun              ();
+            void          UnlockRun            ();
+            void          WaitRun              ();
+            void          WakeRun              ();
+            virtual void  WakeUp               ();
+            int           PlaceThreadAttr      (pthread_attr_t* a_attr);
+            void          PlaceThread          ();
+
         };
 
     } // namespace posix
@@ -26,9 +26,11 @@
 
 #if defined(__APPLE__) || defined(__ANDROID__) || 1 // MARTELADA_TO_REMOVE_WIN32
     #include "osal/posix/posix_worker.h"
+    #include "osal/posix/posix_task_worker.h"
     namespace osal
     {
-        typedef osal::posix::Worker Worker;
+        typedef osal::posix::Worker     Worker;
+        typedef osal::posix::TaskWorker TaskWorker;
     }
 #elif _WIN32
     #include "osal/windows/windows_worker.h"